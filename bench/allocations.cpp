@@ -0,0 +1,33 @@
+#include <atomic>
+#include <cstddef>
+
+#include "allocations.h"
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t number, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static std::atomic<uint64_t> counter{ 0 };
+
+extern "C" void *malloc(size_t size) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t number, size_t size) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(number, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+namespace bench {
+
+uint64_t allocations() {
+    return counter.load(std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,16 @@
+#ifndef SLC_ALLOCATIONS_H_INCLUDED
+#define SLC_ALLOCATIONS_H_INCLUDED
+
+#include <cstdint>
+
+namespace bench {
+
+/**
+ * Number of heap allocations made by this process so far. malloc is
+ * interposed, so this covers operator new as well as nanopb's callbacks.
+ */
+uint64_t allocations();
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SLC_BENCHMARK_H_INCLUDED
+#define SLC_BENCHMARK_H_INCLUDED
+
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "allocations.h"
+
+namespace bench {
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double nsPerOp;
+    double allocationsPerOp;
+};
+
+/**
+ * Runs fn(iterations) once to warm up and then for real, timing the whole
+ * batch so the clock is read twice per benchmark rather than per frame.
+ */
+inline Result run(std::string name, uint64_t iterations, std::function<void(uint64_t)> fn) {
+    fn(iterations / 10 + 1);
+
+    auto allocationsBefore = allocations();
+    auto started = std::chrono::steady_clock::now();
+
+    fn(iterations);
+
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    auto allocated = allocations() - allocationsBefore;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+    return Result{ name, iterations, (double)ns / iterations, (double)allocated / iterations };
+}
+
+inline void print(std::vector<Result> &results) {
+    fprintf(stdout, "\n%-32s %12s %14s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+    for (auto &r : results) {
+        fprintf(stdout, "%-32s %12llu %14.1f %12.2f\n", r.name.c_str(), (unsigned long long)r.iterations, r.nsPerOp, r.allocationsPerOp);
+    }
+}
+
+}
+
+#endif
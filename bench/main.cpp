@@ -0,0 +1,318 @@
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <thread>
+
+#include "node_protocol.h"
+#include "gateway_protocol.h"
+#include "file_writer.h"
+#include "queue.h"
+#include "benchmark.h"
+#include "sx127x_emulator.h"
+
+/**
+ * Radio that keeps the last frame it was asked to send and otherwise does
+ * nothing, so the protocol's own cost can be measured without hardware.
+ */
+class NullRadio : public PacketRadio {
+private:
+    LoraPacket sent_;
+
+public:
+    bool isModeRx() override {
+        return false;
+    }
+
+    bool isModeTx() override {
+        return false;
+    }
+
+    bool isIdle() override {
+        return true;
+    }
+
+    void setModeRx() override {
+    }
+
+    void setModeIdle() override {
+    }
+
+    void sleep() override {
+    }
+
+    bool sendPacket(LoraPacket &packet) override {
+        sent_ = packet;
+        return true;
+    }
+
+    void setThisAddress(uint8_t address) override {
+    }
+
+public:
+    LoraPacket &sent() {
+        return sent_;
+    }
+
+};
+
+class BenchGatewayCallbacks : public GatewayNetworkCallbacks {
+private:
+    stdpath directory_;
+
+public:
+    BenchGatewayCallbacks(stdpath directory) : directory_(directory) {
+    }
+
+public:
+    lws::Writer *openWriter(RadioPacket &packet) override {
+        return new FileWriter(directory_ / "bench.fkpb", packet.m().size);
+    }
+
+    bool closeWriter(lws::Writer *writer, bool success) override {
+        auto fileWriter = reinterpret_cast<FileWriter*>(writer);
+        auto stored = success && fileWriter->commit();
+        delete fileWriter;
+        return stored;
+    }
+
+};
+
+static constexpr size_t ChunkSize = 242 - 24;
+
+static constexpr uint8_t EmulatedCs = 6;
+static constexpr uint8_t EmulatedReset = 0;
+static constexpr uint8_t EmulatedDio0 = 7;
+
+/**
+ * SPI traffic per frame from one of the LoraRadioPi benchmarks.
+ */
+struct DriverCost {
+    std::string name;
+    uint64_t iterations;
+    SpiCounters counters;
+};
+
+static void print(std::vector<DriverCost> &costs) {
+    fprintf(stdout, "\n%-32s %14s %14s %12s\n", "driver (emulated SX127x)", "spi xfers/op", "spi bytes/op", "irqs/op");
+    for (auto &c : costs) {
+        fprintf(stdout, "%-32s %14.1f %14.1f %12.2f\n", c.name.c_str(),
+                (double)c.counters.transactions / c.iterations, (double)c.counters.bytes / c.iterations,
+                (double)c.counters.interrupts / c.iterations);
+    }
+}
+
+static NodeLoraId benchNodeId() {
+    NodeLoraId id;
+    for (auto i = 0; i < (int32_t)id.size; ++i) {
+        id[i] = 0xa0 + i;
+    }
+    return id;
+}
+
+static LoraPacket encodeDataFrame(NullRadio &radio) {
+    uint8_t chunk[ChunkSize];
+    for (auto i = 0u; i < sizeof(chunk); ++i) {
+        chunk[i] = (uint8_t)i;
+    }
+
+    auto nodeId = benchNodeId();
+    NetworkProtocol protocol{ radio };
+    auto packet = RadioPacket{ fk_radio_PacketKind_DATA, nodeId };
+    packet.data(chunk, sizeof(chunk));
+    protocol.sendPacket(std::move(packet));
+    return radio.sent();
+}
+
+/**
+ * Moves n frames through one queue from producers to consumers, the way
+ * frames cross from the radio to the processing side of the gateway.
+ */
+static void contend(LoraPacket &frame, uint64_t n, uint32_t threads, size_t capacity) {
+    ConcurrentQueue<LoraPacket> queue{ capacity };
+    std::vector<std::thread> producers;
+    std::vector<std::thread> consumers;
+
+    for (auto i = 0u; i < threads; ++i) {
+        auto share = n / threads + (i < n % threads ? 1 : 0);
+        producers.emplace_back([&queue, &frame, share] {
+            for (auto j = 0u; j < share; ++j) {
+                queue.push(frame);
+            }
+        });
+        consumers.emplace_back([&queue] {
+            std::vector<LoraPacket> popped;
+            while (queue.pop_all(popped) > 0) {
+                asm volatile("" : : "r"(popped.data()) : "memory");
+                popped.clear();
+            }
+        });
+    }
+
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    queue.close();
+    for (auto &consumer : consumers) {
+        consumer.join();
+    }
+}
+
+int32_t main(int32_t argc, const char **argv) {
+    uint64_t iterations = 100000;
+    auto directory = stdpath{ "/tmp/slc-bench" };
+
+    for (auto i = 0; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--iterations") {
+            if (i + 1 < argc) {
+                iterations = std::stoull(argv[++i]);
+            }
+        }
+        if (arg == "--directory") {
+            if (i + 1 < argc) {
+                directory = argv[++i];
+            }
+        }
+    }
+
+    std::vector<bench::Result> results;
+
+    NullRadio radio;
+    auto frame = encodeDataFrame(radio);
+
+    results.emplace_back(bench::run("sendPacket (DATA encode)", iterations, [&](uint64_t n) {
+        uint8_t chunk[ChunkSize] = { 0 };
+        auto nodeId = benchNodeId();
+        NetworkProtocol protocol{ radio };
+        for (auto i = 0u; i < n; ++i) {
+            auto packet = RadioPacket{ fk_radio_PacketKind_DATA, nodeId };
+            packet.data(chunk, sizeof(chunk));
+            protocol.sendPacket(std::move(packet));
+        }
+    }));
+
+    results.emplace_back(bench::run("RadioPacket::decode (DATA)", iterations, [&](uint64_t n) {
+        for (auto i = 0u; i < n; ++i) {
+            auto packet = RadioPacket{ };
+            packet.decode(frame);
+            free(packet.data().ptr);
+        }
+    }));
+
+    RawPacket raw;
+    raw[0] = frame.to;
+    raw[1] = frame.from;
+    raw[2] = frame.id;
+    raw[3] = frame.flags;
+    memcpy(raw.data + LoraPacket::SX1272_HEADER_LENGTH, frame.data, frame.size);
+    raw.size = frame.size + LoraPacket::SX1272_HEADER_LENGTH;
+
+    results.emplace_back(bench::run("LoraPacket(RawPacket&)", iterations, [&](uint64_t n) {
+        for (auto i = 0u; i < n; ++i) {
+            LoraPacket lora(raw);
+            asm volatile("" : : "r"(&lora) : "memory");
+        }
+    }));
+
+    results.emplace_back(bench::run("DownloadTracker + FileWriter", iterations, [&](uint64_t n) {
+        BenchGatewayCallbacks callbacks{ directory };
+        DownloadTracker tracker{ callbacks };
+        auto log = slc::logFrames();
+
+        auto nodeId = benchNodeId();
+        auto prepare = RadioPacket{ fk_radio_PacketKind_PREPARE, nodeId };
+        prepare.m().size = n * ChunkSize;
+        tracker.prepare(log, frame, prepare);
+
+        auto lora = frame;
+        for (auto i = 0u; i < n; ++i) {
+            auto packet = RadioPacket{ };
+            lora.id = (uint8_t)(i + 1);
+            packet.decode(lora);
+            // Every frame is the same encoding, so place them by hand.
+            packet.m().offset = i * ChunkSize;
+            tracker.download(log, lora, packet);
+            free(packet.data().ptr);
+        }
+
+        auto close = RadioPacket{ fk_radio_PacketKind_DATA, nodeId };
+        close.m().offset = n * ChunkSize;
+        lora.id = (uint8_t)(n + 1);
+        lora.size = 0;
+        tracker.download(log, lora, close);
+    }));
+
+    results.emplace_back(bench::run("ConcurrentQueue push/pop", iterations, [&](uint64_t n) {
+        ConcurrentQueue<LoraPacket> queue;
+        for (auto i = 0u; i < n; ++i) {
+            queue.push(frame);
+            LoraPacket popped;
+            queue.pop(popped);
+            asm volatile("" : : "r"(&popped) : "memory");
+        }
+    }));
+
+    for (auto threads : { 1u, 2u, 4u }) {
+        for (auto capacity : { 0u, 64u }) {
+            std::stringstream name;
+            name << "ConcurrentQueue " << threads << "x" << threads << (capacity > 0 ? " bounded" : "");
+            results.emplace_back(bench::run(name.str(), iterations, [&](uint64_t n) {
+                contend(frame, n, threads, capacity);
+            }));
+        }
+    }
+
+    // The Pi driver itself, register by register, against a software chip.
+    // The RX figure is DIO0 firing through to the frame being queued, popped
+    // and the receiver re-armed, the TX one is a frame written out, TxDone
+    // handled and the receiver re-armed.
+    Sx127xEmulator chip{ EmulatedCs, EmulatedReset, EmulatedDio0 };
+    LoraRadioPi piRadio{ chip, EmulatedCs, EmulatedReset, EmulatedDio0, 0 };
+    piRadio.setup();
+    piRadio.tick();
+
+    // Left holding the timed run's counters, the warm up goes first.
+    SpiCounters rx;
+    SpiCounters tx;
+
+    results.emplace_back(bench::run("LoraRadioPi RX (DATA)", iterations, [&](uint64_t n) {
+        chip.clearCounters();
+        for (auto i = 0u; i < n; ++i) {
+            chip.deliver(frame);
+            LoraPacket lora;
+            piRadio.popIncoming(lora);
+            piRadio.tick();
+        }
+        rx = chip.counters();
+    }));
+
+    NetworkProtocol acking{ radio };
+    acking.sendAck(0x01);
+    auto ack = radio.sent();
+
+    results.emplace_back(bench::run("LoraRadioPi TX (ACK)", iterations, [&](uint64_t n) {
+        chip.clearCounters();
+        for (auto i = 0u; i < n; ++i) {
+            piRadio.sendPacket(ack);
+            chip.finishTransmit();
+            piRadio.tick();
+        }
+        tx = chip.counters();
+    }));
+
+    if (chip.dropped() > 0 || chip.numberSent() == 0) {
+        fprintf(stderr, "LoraRadioPi: %u frames dropped, %u sent\n", chip.dropped(), chip.numberSent());
+    }
+
+    bench::print(results);
+
+    std::vector<DriverCost> costs{
+        DriverCost{ "LoraRadioPi RX (DATA)", iterations, rx },
+        DriverCost{ "LoraRadioPi TX (ACK)", iterations, tx },
+    };
+    print(costs);
+
+    return 0;
+}
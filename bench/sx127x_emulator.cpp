@@ -0,0 +1,272 @@
+#include <cstring>
+
+#include "sx127x_emulator.h"
+
+Sx127xEmulator::Sx127xEmulator(uint8_t pinCs, uint8_t pinReset, uint8_t pinDio0) : pinCs_(pinCs), pinReset_(pinReset), pinDio0_(pinDio0) {
+    reset();
+}
+
+void Sx127xEmulator::reset() {
+    memset(registers_, 0, sizeof(registers_));
+    memset(fifo_, 0, sizeof(fifo_));
+    // Power on values, in FSK standby until someone asks for LoRa.
+    registers_[RH_RF95_REG_01_OP_MODE] = 0x09;
+    registers_[RH_RF95_REG_0E_FIFO_TX_BASE_ADDR] = 0x80;
+    registers_[RH_RF95_REG_1B_RSSI_VALUE] = NoiseFloor + RH_RF95_RSSI_CORRECTION;
+    registers_[RH_RF95_REG_21_PREAMBLE_LSB] = 0x08;
+    registers_[RH_RF95_REG_22_PAYLOAD_LENGTH] = 0x01;
+    registers_[RH_RF95_REG_23_MAX_PAYLOAD_LENGTH] = 0xff;
+    registers_[RH_RF95_REG_42_VERSION] = Version;
+    transmitting_ = false;
+    dio0_ = false;
+    latched_ = false;
+}
+
+void Sx127xEmulator::digitalWrite(uint8_t pin, bool high) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pin == pinCs_) {
+        selected_ = !high;
+    }
+    else if (pin == pinReset_ && !high) {
+        reset();
+    }
+}
+
+void Sx127xEmulator::attachInterrupt(uint8_t pin, void (*handler)()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pin == pinDio0_) {
+        dio0Handler_ = handler;
+    }
+}
+
+void Sx127xEmulator::transfer(uint8_t channel, uint8_t *buffer, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    counters_.transactions++;
+    counters_.bytes += size;
+
+    if (!selected_ || size == 0) {
+        memset(buffer, 0, size);
+        return;
+    }
+
+    auto writing = (buffer[0] & 0x80) == 0x80;
+    auto address = (uint8_t)(buffer[0] & 0x7f);
+    buffer[0] = 0;
+    for (auto i = 1u; i < size; ++i) {
+        if (writing) {
+            write(address, buffer[i]);
+        }
+        else {
+            buffer[i] = read(address);
+        }
+        // Bursts walk the registers, except for the FIFO.
+        if (address != RH_RF95_REG_00_FIFO) {
+            address = (address + 1) & 0x7f;
+        }
+    }
+
+    // Never call back into the driver while it holds its own lock.
+    if (raiseDio0()) {
+        latched_ = true;
+    }
+}
+
+uint8_t Sx127xEmulator::read(uint8_t address) {
+    if (address == RH_RF95_REG_00_FIFO) {
+        return fifo_[registers_[RH_RF95_REG_0D_FIFO_ADDR_PTR]++];
+    }
+    return registers_[address];
+}
+
+void Sx127xEmulator::write(uint8_t address, uint8_t value) {
+    switch (address) {
+    case RH_RF95_REG_00_FIFO: {
+        fifo_[registers_[RH_RF95_REG_0D_FIFO_ADDR_PTR]++] = value;
+        break;
+    }
+    case RH_RF95_REG_01_OP_MODE: {
+        auto current = registers_[RH_RF95_REG_01_OP_MODE];
+        // LongRangeMode can only be changed while asleep.
+        auto lora = (current & RH_RF95_MODE) == RH_RF95_MODE_SLEEP ? value & RH_RF95_LONG_RANGE_MODE : current & RH_RF95_LONG_RANGE_MODE;
+        registers_[RH_RF95_REG_01_OP_MODE] = lora | (value & ~RH_RF95_LONG_RANGE_MODE & ~RH_RF95_MODE);
+        enter(value & RH_RF95_MODE);
+        break;
+    }
+    case RH_RF95_REG_12_IRQ_FLAGS: {
+        registers_[RH_RF95_REG_12_IRQ_FLAGS] &= ~value;
+        break;
+    }
+    case RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR:
+    case RH_RF95_REG_13_RX_NB_BYTES:
+    case RH_RF95_REG_14_RX_HEADER_CNT_VALUE_MSB:
+    case RH_RF95_REG_15_RX_HEADER_CNT_VALUE_LSB:
+    case RH_RF95_REG_16_RX_PACKET_CNT_VALUE_MSB:
+    case RH_RF95_REG_17_RX_PACKET_CNT_VALUE_LSB:
+    case RH_RF95_REG_18_MODEM_STAT:
+    case RH_RF95_REG_19_PKT_SNR_VALUE:
+    case RH_RF95_REG_1A_PKT_RSSI_VALUE:
+    case RH_RF95_REG_1B_RSSI_VALUE:
+    case RH_RF95_REG_42_VERSION: {
+        // Read only.
+        break;
+    }
+    default: {
+        registers_[address] = value;
+        break;
+    }
+    }
+}
+
+void Sx127xEmulator::enter(uint8_t mode) {
+    auto &op = registers_[RH_RF95_REG_01_OP_MODE];
+    op = (op & ~RH_RF95_MODE) | mode;
+    if (mode == RH_RF95_MODE_SLEEP) {
+        // The FIFO doesn't survive sleep.
+        memset(fifo_, 0, sizeof(fifo_));
+    }
+    transmitting_ = mode == RH_RF95_MODE_TX;
+}
+
+bool Sx127xEmulator::raiseDio0() {
+    uint8_t flag = 0;
+    switch (registers_[RH_RF95_REG_40_DIO_MAPPING1] >> 6) {
+    case 0: flag = RH_RF95_RX_DONE; break;
+    case 1: flag = RH_RF95_TX_DONE; break;
+    case 2: flag = RH_RF95_CAD_DONE; break;
+    default: break;
+    }
+    auto level = (registers_[RH_RF95_REG_12_IRQ_FLAGS] & flag) != 0 && (registers_[RH_RF95_REG_11_IRQ_FLAGS_MASK] & flag) == 0;
+    auto rising = level && !dio0_;
+    dio0_ = level;
+    return rising;
+}
+
+bool Sx127xEmulator::takeEdge(bool rising) {
+    rising = rising || latched_;
+    latched_ = false;
+    if (rising && dio0Handler_ != nullptr) {
+        counters_.interrupts++;
+        return true;
+    }
+    return false;
+}
+
+void Sx127xEmulator::interrupt(bool rising) {
+    if (rising) {
+        dio0Handler_();
+    }
+}
+
+bool Sx127xEmulator::serviceInterrupts() {
+    auto rising = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rising = takeEdge(false);
+    }
+    interrupt(rising);
+    return rising;
+}
+
+bool Sx127xEmulator::deliver(LoraPacket &lora, int32_t rssi, int32_t snr) {
+    auto rising = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto mode = registers_[RH_RF95_REG_01_OP_MODE] & RH_RF95_MODE;
+        if (mode != RH_RF95_MODE_RXCONTINUOUS && mode != RH_RF95_MODE_RXSINGLE) {
+            dropped_++;
+            return false;
+        }
+
+        uint8_t base = registers_[RH_RF95_REG_0F_FIFO_RX_BASE_ADDR];
+        uint8_t address = base;
+        fifo_[address++] = lora.to;
+        fifo_[address++] = lora.from;
+        fifo_[address++] = lora.id;
+        fifo_[address++] = lora.flags;
+        for (auto i = 0; i < lora.size; ++i) {
+            fifo_[address++] = lora.data[i];
+        }
+
+        registers_[RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR] = base;
+        registers_[RH_RF95_REG_13_RX_NB_BYTES] = lora.size + LoraPacket::SX1272_HEADER_LENGTH;
+        registers_[RH_RF95_REG_19_PKT_SNR_VALUE] = (uint8_t)(int8_t)(snr * 4);
+        registers_[RH_RF95_REG_1A_PKT_RSSI_VALUE] = rssi + RH_RF95_RSSI_CORRECTION;
+        registers_[RH_RF95_REG_12_IRQ_FLAGS] |= RH_RF95_RX_DONE | RH_RF95_VALID_HEADER;
+
+        if (mode == RH_RF95_MODE_RXSINGLE) {
+            enter(RH_RF95_MODE_STDBY);
+        }
+
+        rising = takeEdge(raiseDio0());
+    }
+    interrupt(rising);
+    return true;
+}
+
+bool Sx127xEmulator::finishTransmit() {
+    auto rising = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!transmitting_) {
+            return false;
+        }
+
+        RawPacket raw;
+        uint8_t address = registers_[RH_RF95_REG_0E_FIFO_TX_BASE_ADDR];
+        raw.size = registers_[RH_RF95_REG_22_PAYLOAD_LENGTH];
+        for (auto i = 0; i < raw.size; ++i) {
+            raw[i] = fifo_[address++];
+        }
+        sent_ = LoraPacket(raw);
+        numberSent_++;
+
+        registers_[RH_RF95_REG_12_IRQ_FLAGS] |= RH_RF95_TX_DONE;
+        enter(RH_RF95_MODE_STDBY);
+
+        rising = takeEdge(raiseDio0());
+    }
+    interrupt(rising);
+    return true;
+}
+
+bool Sx127xEmulator::timeoutRx() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if ((registers_[RH_RF95_REG_01_OP_MODE] & RH_RF95_MODE) != RH_RF95_MODE_RXSINGLE) {
+        return false;
+    }
+    // RxTimeout is on DIO1, which isn't wired, so no edge.
+    registers_[RH_RF95_REG_12_IRQ_FLAGS] |= RH_RF95_RX_TIMEOUT;
+    enter(RH_RF95_MODE_STDBY);
+    return true;
+}
+
+uint8_t Sx127xEmulator::mode() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return registers_[RH_RF95_REG_01_OP_MODE] & RH_RF95_MODE;
+}
+
+LoraPacket Sx127xEmulator::sent() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sent_;
+}
+
+uint32_t Sx127xEmulator::numberSent() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return numberSent_;
+}
+
+uint32_t Sx127xEmulator::dropped() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+}
+
+SpiCounters Sx127xEmulator::counters() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counters_;
+}
+
+void Sx127xEmulator::clearCounters() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_ = SpiCounters{ };
+}
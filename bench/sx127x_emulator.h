@@ -0,0 +1,117 @@
+#ifndef SLC_SX127X_EMULATOR_H_INCLUDED
+#define SLC_SX127X_EMULATOR_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+#include "lora_radio_pi.h"
+
+struct SpiCounters {
+    // Chip select cycles, one per register access from LoraRadioPi.
+    uint64_t transactions{ 0 };
+    uint64_t bytes{ 0 };
+    // DIO0 rising edges handed to the driver.
+    uint64_t interrupts{ 0 };
+};
+
+/**
+ * Register level model of an SX1276/7/8/9 in LoRa mode, enough to run
+ * LoraRadioPi against: the FIFO and its pointers, op mode transitions,
+ * IRQ flags with DIO0 on RxDone or TxDone, packet RSSI/SNR and the version
+ * register. Frames come in over deliver() and leave when the owner calls
+ * finishTransmit(), there's no notion of airtime.
+ *
+ * DIO0 handlers are called on the thread that caused the edge, after the
+ * model's own lock is released, so the driver can read registers from them.
+ * An edge caused by a register write is latched instead, the driver is in
+ * the middle of its own locked transaction, and handed over by the next
+ * deliver(), finishTransmit() or serviceInterrupts().
+ */
+class Sx127xEmulator : public SpiBackend {
+public:
+    static constexpr uint8_t Version = 0x12;
+    static constexpr int32_t NoiseFloor = -120;
+
+private:
+    std::mutex mutex_;
+    uint8_t pinCs_;
+    uint8_t pinReset_;
+    uint8_t pinDio0_;
+    void (*dio0Handler_)(){ nullptr };
+    bool selected_{ false };
+    bool dio0_{ false };
+    bool latched_{ false };
+    uint8_t registers_[0x80];
+    uint8_t fifo_[256];
+    bool transmitting_{ false };
+    LoraPacket sent_;
+    uint32_t numberSent_{ 0 };
+    uint32_t dropped_{ 0 };
+    SpiCounters counters_;
+
+public:
+    Sx127xEmulator(uint8_t pinCs, uint8_t pinReset, uint8_t pinDio0);
+
+public:
+    void pinMode(uint8_t pin, bool output) override {
+    }
+
+    void digitalWrite(uint8_t pin, bool high) override;
+    void attachInterrupt(uint8_t pin, void (*handler)()) override;
+    void transfer(uint8_t channel, uint8_t *buffer, size_t size) override;
+
+    void delay(uint32_t ms) override {
+    }
+
+public:
+    /**
+     * Hands the chip a frame off the air. Dropped, returning false, unless
+     * the chip is receiving.
+     */
+    bool deliver(LoraPacket &lora, int32_t rssi = -60, int32_t snr = 8);
+
+    /**
+     * Ends a transmission in progress as if its last symbol had gone out.
+     * False if the chip wasn't transmitting.
+     */
+    bool finishTransmit();
+
+    /**
+     * Closes an RX single window that heard nothing.
+     */
+    bool timeoutRx();
+
+    /**
+     * Hands the driver any DIO0 edge a register write latched. True if
+     * there was one.
+     */
+    bool serviceInterrupts();
+
+    uint8_t mode();
+
+    /**
+     * The last frame transmitted.
+     */
+    LoraPacket sent();
+
+    uint32_t numberSent();
+
+    uint32_t dropped();
+
+    SpiCounters counters();
+
+    void clearCounters();
+
+private:
+    void reset();
+    uint8_t read(uint8_t address);
+    void write(uint8_t address, uint8_t value);
+    void enter(uint8_t mode);
+    bool raiseDio0();
+    bool takeEdge(bool rising);
+    void interrupt(bool rising);
+
+};
+
+#endif
@@ -45,6 +45,10 @@ private:
     lws::CountingReader reader { 4096 };
 
 public:
+    size_t pendingSize() override {
+        return 4096;
+    }
+
     NodeNetworkCallbacks::OpenedReader openReader() override {
         reader = lws::CountingReader(4096);
         return NodeNetworkCallbacks::OpenedReader{ &reader, 4096 };
@@ -55,6 +59,17 @@ public:
 
 };
 
+/**
+ * Waits for up to ms or until the radio has a packet. This is where the
+ * board would drop into standby and wake on DIO0 or the RTC.
+ */
+static void waitForRadio(LoraRadioRadioHead &radio, uint32_t ms) {
+    auto started = millis();
+    while (millis() - started < ms && !radio.hasPacket()) {
+        delay(1);
+    }
+}
+
 void setup() {
     Serial.begin(115200);
 
@@ -68,17 +83,17 @@ void setup() {
 
     NodeLoraId nodeId;
     if (!eeprom.read128bMac(nodeId)) {
-        slc::log() << "lora-test: No address";
+        slc::logErrors() << "lora-test: No address";
         while (true);
     }
 
     LoraRadioRadioHead radio{ 5, 2, 0, 3 };
     if (!radio.setup()) {
-        slc::log() << "lora-test: No radio";
+        slc::logErrors() << "lora-test: No radio";
         while (true);
     }
 
-    slc::log() << "lora-test: Ready";
+    slc::logInfo() << "lora-test: Ready";
 
     pinMode(13, OUTPUT);
 
@@ -92,9 +107,20 @@ void setup() {
 
     protocol.setNodeId(nodeId);
 
+    auto reported = false;
+
     while (true) {
         protocol.tick();
 
+        // What led up to it, once per failure.
+        if (protocol.hasErrorOccured() != reported) {
+            reported = !reported;
+            if (reported) {
+                protocol.trace().dump();
+                protocol.stateStats().dump();
+            }
+        }
+
         if (protocol.hasBeenSleepingFor(20000))  {
             protocol.sendToGateway();
         }
@@ -104,7 +130,12 @@ void setup() {
             protocol.push(lora);
         }
 
-        delay(10);
+        auto wait = protocol.nextDeadline();
+        if (protocol.isSleeping()) {
+            auto wake = protocol.untilInStateFor(20000);
+            wait = wake < wait ? wake : wait;
+        }
+        waitForRadio(radio, wait);
     }
 }
 
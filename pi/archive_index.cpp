@@ -0,0 +1,229 @@
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive_index.h"
+
+ArchiveIndex::ArchiveIndex(stdpath path) : path_(path) {
+}
+
+ArchiveIndex::~ArchiveIndex() {
+    close();
+}
+
+bool ArchiveIndex::open(bool writable) {
+    close();
+
+    writable_ = writable;
+
+    fd_ = ::open(path_.c_str(), writable ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+    if (fd_ < 0) {
+        if (writable) {
+            std::cerr << "Unable to open: " << path_ << " (" << strerror(errno) << ")" << std::endl;
+        }
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        close();
+        return false;
+    }
+
+    auto size = (size_t)st.st_size;
+    auto empty = size < sizeof(ArchiveIndexHeader);
+    if (empty) {
+        if (!writable) {
+            close();
+            return false;
+        }
+        size = sizeof(ArchiveIndexHeader) + InitialCapacity * sizeof(ArchiveRecord);
+        if (ftruncate(fd_, size) != 0) {
+            std::cerr << "Unable to size: " << path_ << " (" << strerror(errno) << ")" << std::endl;
+            close();
+            return false;
+        }
+    }
+
+    if (!map(size)) {
+        close();
+        return false;
+    }
+
+    if (empty) {
+        memset(header(), 0, sizeof(ArchiveIndexHeader));
+        header()->magic = Magic;
+        header()->version = Version;
+    }
+
+    if (header()->magic != Magic || header()->version != Version || header()->count > capacity()) {
+        std::cerr << "Invalid index: " << path_ << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void ArchiveIndex::close() {
+    if (map_ != nullptr) {
+        if (writable_) {
+            msync(map_, mapped_, MS_SYNC);
+        }
+        munmap(map_, mapped_);
+        map_ = nullptr;
+        mapped_ = 0;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool ArchiveIndex::map(size_t size) {
+    auto protection = writable_ ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    auto ptr = mmap(nullptr, size, protection, MAP_SHARED, fd_, 0);
+    if (ptr == MAP_FAILED) {
+        std::cerr << "Unable to map: " << path_ << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    map_ = (uint8_t *)ptr;
+    mapped_ = size;
+    return true;
+}
+
+bool ArchiveIndex::grow() {
+    auto size = sizeof(ArchiveIndexHeader) + capacity() * 2 * sizeof(ArchiveRecord);
+
+    msync(map_, mapped_, MS_SYNC);
+    munmap(map_, mapped_);
+    map_ = nullptr;
+
+    if (ftruncate(fd_, size) != 0) {
+        std::cerr << "Unable to grow: " << path_ << " (" << strerror(errno) << ")" << std::endl;
+        return map(mapped_);
+    }
+
+    return map(size);
+}
+
+bool ArchiveIndex::append(const ArchiveRecord &record) {
+    if (map_ == nullptr || !writable_) {
+        return false;
+    }
+
+    if (header()->count == capacity()) {
+        if (!grow() || header()->count == capacity()) {
+            return false;
+        }
+    }
+
+    records()[header()->count] = record;
+    header()->count++;
+
+    if (header()->count - header()->sorted >= MergeThreshold) {
+        if (!merge()) {
+            // The record's still in the tail, the next append tries again.
+            std::cerr << "Unable to merge: " << path_ << std::endl;
+        }
+    }
+    else {
+        msync(map_, mapped_, MS_ASYNC);
+    }
+
+    return true;
+}
+
+bool ArchiveIndex::merge() {
+    if (map_ == nullptr || !writable_) {
+        return false;
+    }
+
+    auto begin = records();
+    auto middle = begin + header()->sorted;
+    auto end = begin + header()->count;
+    if (middle == end) {
+        return true;
+    }
+
+    // Until the merge is done lookups treat every record as tail, which is
+    // slow but right, and a crash part way through gets it all re-sorted.
+    header()->sorted = 0;
+    if (msync(map_, sizeof(ArchiveIndexHeader), MS_SYNC) != 0) {
+        std::cerr << "Unable to sync: " << path_ << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    std::sort(middle, end);
+    std::inplace_merge(begin, middle, end);
+
+    if (msync(map_, mapped_, MS_SYNC) != 0) {
+        std::cerr << "Unable to sync: " << path_ << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    header()->sorted = header()->count;
+    if (msync(map_, sizeof(ArchiveIndexHeader), MS_SYNC) != 0) {
+        std::cerr << "Unable to sync: " << path_ << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<ArchiveRecord> ArchiveIndex::find(const uint8_t *nodeId, uint64_t from, uint64_t to) {
+    std::vector<ArchiveRecord> found;
+    if (map_ == nullptr) {
+        return found;
+    }
+
+    ArchiveRecord low;
+    memset(&low, 0, sizeof(low));
+    memcpy(low.nodeId, nodeId, sizeof(low.nodeId));
+    low.timestamp = from;
+
+    ArchiveRecord high = low;
+    high.timestamp = to;
+
+    auto begin = records();
+    auto sorted = begin + header()->sorted;
+    auto end = begin + header()->count;
+
+    auto first = std::lower_bound(begin, sorted, low);
+    auto last = std::upper_bound(first, sorted, high);
+    found.insert(found.end(), first, last);
+
+    for (auto i = sorted; i != end; ++i) {
+        if (memcmp(i->nodeId, nodeId, sizeof(i->nodeId)) == 0 && i->timestamp >= from && i->timestamp <= to) {
+            found.push_back(*i);
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+
+    return found;
+}
+
+std::vector<ArchiveRecord> ArchiveIndex::find(uint64_t from, uint64_t to) {
+    std::vector<ArchiveRecord> found;
+    if (map_ == nullptr) {
+        return found;
+    }
+
+    auto begin = records();
+    auto end = begin + header()->count;
+    for (auto i = begin; i != end; ++i) {
+        if (i->timestamp >= from && i->timestamp <= to) {
+            found.push_back(*i);
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+
+    return found;
+}
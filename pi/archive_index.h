@@ -0,0 +1,112 @@
+#ifndef SLC_ARCHIVE_INDEX_H_INCLUDED
+#define SLC_ARCHIVE_INDEX_H_INCLUDED
+
+#include <experimental/filesystem>
+#include <vector>
+
+#include "archive_record.h"
+
+using stdpath = std::experimental::filesystem::path;
+
+struct __attribute__((packed)) ArchiveIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Records [0, sorted) are ordered by node and then timestamp, the ones
+    // after that are recent appends waiting to be merged in.
+    uint64_t sorted;
+    uint64_t count;
+    uint8_t reserved[40];
+};
+
+static_assert(sizeof(ArchiveIndexHeader) == 64, "ArchiveIndexHeader is part of the on disk format");
+
+/**
+ * Memory mapped, fixed record index of every upload in the archive, sorted
+ * by node and timestamp so a node's uploads in a time range are a binary
+ * search away. New records are appended to an unsorted tail which is merged
+ * in once it grows past MergeThreshold, keeping appends cheap and lookups
+ * at one search plus a short scan.
+ */
+class ArchiveIndex {
+public:
+    static constexpr uint32_t Magic = 0x32494b46; // FKI2
+    static constexpr uint32_t Version = 1;
+    static constexpr uint64_t InitialCapacity = 4096;
+    static constexpr uint64_t MergeThreshold = 256;
+
+private:
+    stdpath path_;
+    int32_t fd_{ -1 };
+    bool writable_{ false };
+    uint8_t *map_{ nullptr };
+    size_t mapped_{ 0 };
+
+public:
+    ArchiveIndex(stdpath path);
+    virtual ~ArchiveIndex();
+
+public:
+    bool open(bool writable);
+    void close();
+
+    bool append(const ArchiveRecord &record);
+
+    /**
+     * Sorts the tail into the rest of the index in place and syncs it. Only
+     * the records the tail lands among move.
+     */
+    bool merge();
+
+    /**
+     * Records for the node with timestamps in [from, to], in time order.
+     */
+    std::vector<ArchiveRecord> find(const uint8_t *nodeId, uint64_t from, uint64_t to);
+
+    /**
+     * Every record with a timestamp in [from, to], ordered by node and time.
+     */
+    std::vector<ArchiveRecord> find(uint64_t from, uint64_t to);
+
+public:
+    bool isOpen() {
+        return map_ != nullptr;
+    }
+
+    uint64_t size() {
+        return map_ == nullptr ? 0 : header()->count;
+    }
+
+    stdpath path() {
+        return path_;
+    }
+
+private:
+    ArchiveIndexHeader *header() {
+        return reinterpret_cast<ArchiveIndexHeader*>(map_);
+    }
+
+    ArchiveRecord *records() {
+        return reinterpret_cast<ArchiveRecord*>(map_ + sizeof(ArchiveIndexHeader));
+    }
+
+    uint64_t capacity() {
+        return (mapped_ - sizeof(ArchiveIndexHeader)) / sizeof(ArchiveRecord);
+    }
+
+    bool map(size_t size);
+    bool grow();
+
+};
+
+/**
+ * Ordering used by the index, node first and then timestamp.
+ */
+inline bool operator<(const ArchiveRecord &a, const ArchiveRecord &b) {
+    auto c = memcmp(a.nodeId, b.nodeId, sizeof(a.nodeId));
+    if (c != 0) {
+        return c < 0;
+    }
+    return a.timestamp < b.timestamp;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#include "archive_record.h"
+
+struct Crc32Table {
+    uint32_t values[256];
+
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (auto j = 0; j < 8; ++j) {
+                c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+            }
+            values[i] = c;
+        }
+    }
+};
+
+uint32_t crc32(uint32_t crc, const uint8_t *ptr, size_t size) {
+    static Crc32Table table;
+
+    crc = ~crc;
+    for (auto i = (size_t)0; i < size; ++i) {
+        crc = table.values[(crc ^ ptr[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,76 @@
+#ifndef SLC_ARCHIVE_RECORD_H_INCLUDED
+#define SLC_ARCHIVE_RECORD_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <experimental/filesystem>
+
+#include "device_id.h"
+
+/**
+ * One completed upload, as stored in the archive index. Fixed size and
+ * packed so the index can be read and written as a flat array.
+ */
+struct __attribute__((packed)) ArchiveRecord {
+    uint8_t nodeId[8];
+    // Milliseconds since the epoch when the upload started.
+    uint64_t timestamp;
+    uint32_t segment;
+    uint32_t length;
+    // Where the record's header starts in the segment.
+    uint64_t offset;
+    uint32_t crc;
+    uint32_t reserved;
+};
+
+// Segment number used for uploads stored as individual files.
+constexpr uint32_t ArchiveFileSegment = 0;
+
+static_assert(sizeof(ArchiveRecord) == 40, "ArchiveRecord is part of the on disk format");
+
+inline std::string toHex(const uint8_t *ptr, size_t size) {
+    std::stringstream ss;
+    for (auto i = 0; i < (int32_t)size; ++i) {
+        ss << std::setfill('0') << std::setw(2) << std::hex << (int32_t)ptr[i];
+    }
+    return ss.str();
+}
+
+inline std::string toHex(const NodeLoraId &id) {
+    return toHex(id.ptr, id.size);
+}
+
+/**
+ * Where the file store keeps an upload that started at the given time:
+ * <archive>/<nodeId>/<YYYYMMDD>/<HHMMSS>_<mmm>_fkn.fkpb
+ */
+inline std::experimental::filesystem::path fileArchivePath(std::string archive, const uint8_t *nodeId, uint64_t timestamp) {
+    std::time_t t = timestamp / 1000;
+    std::tm tm = *std::localtime(&t);
+    std::stringstream buffer;
+    buffer << archive << "/";
+    buffer << toHex(nodeId, 8) << "/";
+    buffer << std::put_time(&tm, "%Y%m%d/%H%M%S") << "_";
+    buffer << std::setfill('0') << std::setw(3) << timestamp % 1000 << "_";
+    buffer << "fkn.fkpb";
+    return std::experimental::filesystem::path{ buffer.str() };
+}
+
+/**
+ * Where the segment store keeps a node's segment: <archive>/<nodeId>/<number>.fks
+ */
+inline std::experimental::filesystem::path segmentArchivePath(std::string archive, const uint8_t *nodeId, uint32_t number) {
+    std::stringstream buffer;
+    buffer << archive << "/";
+    buffer << toHex(nodeId, 8) << "/";
+    buffer << std::setfill('0') << std::setw(8) << number << ".fks";
+    return std::experimental::filesystem::path{ buffer.str() };
+}
+
+uint32_t crc32(uint32_t crc, const uint8_t *ptr, size_t size);
+
+#endif
@@ -1,49 +1,214 @@
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "file_writer.h"
+#include "archive_record.h"
 #include "packet_radio.h"
 
-FileWriter::FileWriter(std::experimental::filesystem::path path) : path_(path) {
+FileWriter::FileWriter(std::experimental::filesystem::path path, size_t expected) : path_(path), expected_(expected < MaximumReservation ? expected : MaximumReservation) {
+    temporary_ = path_.parent_path() / ("." + path_.filename().string() + ".partial");
+}
+
+FileWriter::~FileWriter() {
+    if (!committed_) {
+        abort();
+    }
+    free(buffer_);
 }
 
 bool FileWriter::open() {
+    if (failed_) {
+        return false;
+    }
+
     auto directory = path_.parent_path();
 
     if (!std::experimental::filesystem::exists(directory)) {
         if (!std::experimental::filesystem::create_directories(directory)) {
             std::cerr << "Unable to create directories: " << directory << std::endl;
+            failed_ = true;
+            return false;
+        }
+    }
+
+    slc::logInfo() << "Creating " << path_.c_str();
+
+    if (buffer_ == nullptr) {
+        if (posix_memalign((void **)&buffer_, BlockAlignment, BlockSize) != 0) {
+            std::cerr << "Unable to allocate buffer: " << path_ << std::endl;
+            buffer_ = nullptr;
+            failed_ = true;
             return false;
         }
     }
 
-    slc::log() << "Creating " << path_.c_str();
+    fd_ = ::open(temporary_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "Unable to open: " << temporary_ << " (" << strerror(errno) << ")" << std::endl;
+        failed_ = true;
+        return false;
+    }
+
+    if (expected_ > 0) {
+        // Reserve the whole upload now so the card can lay it out in one
+        // go. KEEP_SIZE means the file still only reports what we've
+        // written. Not every filesystem supports this, which is fine.
+        fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, expected_);
+    }
 
-    of_.open(path_, std::ios::binary);
+    buffered_ = 0;
+    written_ = 0;
+    crc_ = 0;
 
-    return of_.is_open();
+    return true;
 }
 
 int32_t FileWriter::write(uint8_t *ptr, size_t size) {
-    if (!of_.is_open()) {
+    if (fd_ < 0) {
         if (!open()) {
             return 0;
         }
     }
-    of_.write(reinterpret_cast<char*>(ptr), size);
-    of_.flush();
+
+    crc_ = crc32(crc_, ptr, size);
+
+    auto remaining = size;
+    while (remaining > 0) {
+        auto copying = std::min(remaining, BlockSize - buffered_);
+        memcpy(buffer_ + buffered_, ptr, copying);
+        buffered_ += copying;
+        ptr += copying;
+        remaining -= copying;
+
+        if (buffered_ == BlockSize) {
+            if (!flush()) {
+                return size - remaining;
+            }
+        }
+    }
+
     return size;
 }
 
 int32_t FileWriter::write(uint8_t byte) {
-    if (!of_.is_open()) {
+    return write(&byte, 1);
+}
+
+void FileWriter::close() {
+    if (fd_ >= 0) {
+        flush();
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool FileWriter::commit() {
+    if (failed_) {
+        abort();
+        return false;
+    }
+
+    if (fd_ < 0 && written_ == 0) {
+        // Nothing was ever written, publish an empty file.
         if (!open()) {
-            return 0;
+            return false;
+        }
+    }
+
+    if (fd_ >= 0) {
+        auto flushed = flush();
+        if (flushed) {
+            // Drop any of the reservation we didn't use.
+            flushed = ftruncate(fd_, written_) == 0 && fsync(fd_) == 0;
+        }
+        ::close(fd_);
+        fd_ = -1;
+        if (!flushed) {
+            std::cerr << "Unable to sync: " << temporary_ << " (" << strerror(errno) << ")" << std::endl;
+            unlink(temporary_.c_str());
+            return false;
         }
     }
-    of_.put(byte);
-    return 1;
+
+    if (!publish()) {
+        std::cerr << "Unable to publish: " << path_ << " (" << strerror(errno) << ")" << std::endl;
+        unlink(temporary_.c_str());
+        return false;
+    }
+
+    committed_ = true;
+
+    auto directory = ::open(path_.parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory >= 0) {
+        fsync(directory);
+        ::close(directory);
+    }
+
+    return true;
 }
 
-void FileWriter::close() {
-    if (of_.is_open()) {
-        of_.close();
+void FileWriter::abort() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    buffered_ = 0;
+    unlink(temporary_.c_str());
+}
+
+bool FileWriter::publish() {
+    // link() fails with EEXIST rather than replacing an upload that's
+    // already been published under the same name.
+    if (link(temporary_.c_str(), path_.c_str()) == 0) {
+        unlink(temporary_.c_str());
+        return true;
+    }
+
+    if (errno != EPERM && errno != EOPNOTSUPP) {
+        return false;
+    }
+
+    // No hard links on this filesystem.
+    if (access(path_.c_str(), F_OK) == 0) {
+        errno = EEXIST;
+        return false;
+    }
+
+    return rename(temporary_.c_str(), path_.c_str()) == 0;
+}
+
+bool FileWriter::flush() {
+    if (buffered_ == 0) {
+        return true;
+    }
+
+    if (!writeFully(buffer_, buffered_)) {
+        std::cerr << "Unable to write: " << temporary_ << " (" << strerror(errno) << ")" << std::endl;
+        failed_ = true;
+        return false;
+    }
+
+    written_ += buffered_;
+    buffered_ = 0;
+
+    return true;
+}
+
+bool FileWriter::writeFully(uint8_t *ptr, size_t size) {
+    while (size > 0) {
+        auto bytes = ::write(fd_, ptr, size);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ptr += bytes;
+        size -= bytes;
     }
+    return true;
 }
@@ -10,25 +10,76 @@
 
 using stdpath = std::experimental::filesystem::path;
 
+/**
+ * Writes an upload to a hidden temporary file next to its final path,
+ * buffering in memory and writing whole blocks. The file only appears under
+ * its real name once commit() has synced it, so anything scanning the
+ * archive never sees a partial upload.
+ */
 class FileWriter : public lws::Writer {
+public:
+    static constexpr size_t BlockSize = 64 * 1024;
+    static constexpr size_t BlockAlignment = 4096;
+    // Never reserve more than the gateway accepts for one upload, see
+    // DownloadTracker::MaximumUploadSize.
+    static constexpr size_t MaximumReservation = 16 * 1024 * 1024;
+
 private:
     stdpath path_;
-    std::ofstream of_;
+    stdpath temporary_;
+    size_t expected_{ 0 };
+    int32_t fd_{ -1 };
+    uint8_t *buffer_{ nullptr };
+    size_t buffered_{ 0 };
+    size_t written_{ 0 };
+    uint32_t crc_{ 0 };
+    bool failed_{ false };
+    bool committed_{ false };
 
 public:
-    FileWriter(stdpath path);
+    FileWriter(stdpath path, size_t expected = 0);
+    virtual ~FileWriter();
 
 public:
     bool open();
     int32_t write(uint8_t *ptr, size_t size) override;
     int32_t write(uint8_t byte) override;
+
+    /**
+     * Writes out anything buffered and closes the file, leaving it under its
+     * temporary name.
+     */
     void close() override;
 
+    /**
+     * Flushes, syncs and atomically moves the file to its final path. Fails
+     * rather than replace a file already there.
+     */
+    bool commit();
+
+    /**
+     * Closes and removes the temporary file.
+     */
+    void abort();
+
 public:
     stdpath path() {
         return path_;
     }
 
+    size_t size() {
+        return written_ + buffered_;
+    }
+
+    uint32_t crc() {
+        return crc_;
+    }
+
+private:
+    bool publish();
+    bool flush();
+    bool writeFully(uint8_t *ptr, size_t size);
+
 };
 
 #endif
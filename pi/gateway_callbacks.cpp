@@ -1,38 +1,182 @@
+#include <cstring>
 #include <iomanip>
+#include <chrono>
 
 #include "gateway_callbacks.h"
+#include "segment_writer.h"
+
+static uint64_t timestampNow() {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+}
+
+void PendingGatewayCallbacks::indexed(const ArchiveRecord &record) {
+    if (!index_.isOpen()) {
+        std::experimental::filesystem::create_directories(path_);
+        if (!index_.open(true)) {
+            return;
+        }
+    }
+    if (!index_.append(record)) {
+        std::cerr << "Unable to index: " << toHex(record.nodeId, sizeof(record.nodeId)) << " " << record.timestamp << std::endl;
+    }
+}
+
+lws::Writer *PendingGatewayCallbacks::tap(lws::Writer *writer, const ArchiveRecord &record, size_t expected, bool collecting) {
+    if (observers_.empty()) {
+        return writer;
+    }
+
+    Upload upload;
+    memcpy(upload.node_id, record.nodeId, sizeof(upload.node_id));
+    upload.timestamp = record.timestamp;
+    upload.expected = expected;
+
+    for (auto observer : observers_) {
+        observer->begin(upload);
+    }
+
+    return new TeeWriter(writer, observers_, upload, collecting);
+}
+
+lws::Writer *PendingGatewayCallbacks::target(lws::Writer *writer) {
+    if (observers_.empty()) {
+        return writer;
+    }
+    return reinterpret_cast<TeeWriter*>(writer)->target();
+}
+
+void PendingGatewayCallbacks::untap(lws::Writer *writer) {
+    if (!observers_.empty()) {
+        delete reinterpret_cast<TeeWriter*>(writer);
+    }
+}
+
+void PendingGatewayCallbacks::completed(lws::Writer *writer, const stdpath &path) {
+    if (observers_.empty()) {
+        return;
+    }
+
+    auto &collected = reinterpret_cast<TeeWriter*>(writer)->collected();
+    completed(writer, path, collected.data(), collected.size());
+}
+
+void PendingGatewayCallbacks::completed(lws::Writer *writer, const stdpath &path, const uint8_t *ptr, size_t size) {
+    if (observers_.empty()) {
+        return;
+    }
+
+    auto &upload = reinterpret_cast<TeeWriter*>(writer)->upload();
+    for (auto observer : observers_) {
+        observer->complete(upload, path.c_str(), ptr, size);
+    }
+}
+
+void PendingGatewayCallbacks::aborted(lws::Writer *writer) {
+    if (observers_.empty()) {
+        return;
+    }
+
+    auto &upload = reinterpret_cast<TeeWriter*>(writer)->upload();
+    for (auto observer : observers_) {
+        observer->aborted(upload);
+    }
+}
+
+void PendingGatewayCallbacks::priority(RadioPacket &packet) {
+    auto data = packet.data();
+
+    slc::logInfo() << "Priority: " << packet.getNodeId() << " (" << data.size << " bytes)";
+
+    Upload upload;
+    memcpy(upload.node_id, packet.getNodeId().ptr, sizeof(upload.node_id));
+    upload.timestamp = timestampNow();
+    upload.expected = data.size;
+
+    for (auto observer : observers_) {
+        observer->priority(upload, data.ptr, data.size);
+    }
+}
 
 lws::Writer *ArchivingGatewayCallbacks::openWriter(RadioPacket &packet) {
-    auto path = getPath(packet);
-    return new FileWriter(path);
+    ArchiveRecord record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.nodeId, packet.getNodeId().ptr, sizeof(record.nodeId));
+    record.timestamp = timestampNow();
+    record.segment = ArchiveFileSegment;
+
+    // The path is all the index keeps, so it has to be unique per upload.
+    auto &last = timestamps_[toHex(record.nodeId, sizeof(record.nodeId))];
+    if (record.timestamp <= last) {
+        record.timestamp = last + 1;
+    }
+    last = record.timestamp;
+
+    auto path = fileArchivePath(path_, record.nodeId, record.timestamp);
+    auto writer = new FileWriter(path, packet.m().size);
+    auto tapped = tap(writer, record, packet.m().size, true);
+    opened_[tapped] = Opened{ writer, record };
+    return tapped;
 }
 
-void ArchivingGatewayCallbacks::closeWriter(lws::Writer *writer, bool success) {
+bool ArchivingGatewayCallbacks::closeWriter(lws::Writer *writer, bool success) {
+    auto stored = false;
     if (writer != nullptr) {
-        writer->close();
-        if (success) {
-            auto fileWriter = reinterpret_cast<FileWriter*>(writer);
+        auto opened = opened_[writer];
+        auto fileWriter = opened.writer;
+        auto &record = opened.record;
+        opened_.erase(writer);
+        stored = success && fileWriter->commit();
+        if (stored) {
+            record.length = fileWriter->size();
+            record.crc = fileWriter->crc();
+            indexed(record);
             pending_.emplace(fileWriter->path());
+            completed(writer, fileWriter->path());
         }
+        else {
+            fileWriter->abort();
+            aborted(writer);
+        }
+        untap(writer);
+        delete fileWriter;
     }
+    return stored;
 }
 
-std::string ArchivingGatewayCallbacks::getNodeId(RadioPacket &packet) {
-    auto& id = packet.getNodeId();
-    std::stringstream ss;
-    for (auto i = 0; i < (int32_t)id.size; ++i) {
-        ss << std::setfill('0') << std::setw(2) << std::hex << (int32_t)id.ptr[i];
-    }
-    return ss.str();
+lws::Writer *SegmentedGatewayCallbacks::openWriter(RadioPacket &packet) {
+    ArchiveRecord record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.nodeId, packet.getNodeId().ptr, sizeof(record.nodeId));
+    record.timestamp = timestampNow();
+
+    auto writer = new SegmentWriter(store_, packet.getNodeId(), record.timestamp, packet.m().size);
+    // The SegmentWriter already has the whole upload in memory.
+    return tap(writer, record, packet.m().size, false);
 }
 
-stdpath ArchivingGatewayCallbacks::getPath(RadioPacket &packet) {
-    std::time_t t = std::time(nullptr);
-    std::tm tm = *std::localtime(&t);
-    std::stringstream buffer;
-    buffer << path_ << "/";
-    buffer << getNodeId(packet) << "/";
-    buffer << std::put_time(&tm, "%Y%m%d/%H%M%S") << "_";
-    buffer << "fkn.fkpb";
-    return stdpath{ buffer.str() };
+bool SegmentedGatewayCallbacks::closeWriter(lws::Writer *writer, bool success) {
+    auto stored = false;
+    if (writer != nullptr) {
+        auto segmentWriter = reinterpret_cast<SegmentWriter*>(target(writer));
+        ArchiveRecord record;
+        stored = success && segmentWriter->commit(record);
+        if (stored) {
+            indexed(record);
+            auto &buffer = segmentWriter->buffer();
+            completed(writer, segmentArchivePath(path_, record.nodeId, record.segment), buffer.data(), buffer.size());
+        }
+        else {
+            aborted(writer);
+        }
+        untap(writer);
+        delete segmentWriter;
+
+        auto &sealed = store_.sealed();
+        while (!sealed.empty()) {
+            pending_.emplace(sealed.front());
+            sealed.pop();
+        }
+    }
+    return stored;
 }
@@ -3,20 +3,30 @@
 
 #include <string>
 #include <queue>
+#include <map>
 #include <experimental/filesystem>
 
 #include "gateway_protocol.h"
 #include "file_writer.h"
+#include "segment_store.h"
+#include "archive_index.h"
+#include "upload_observer.h"
 
 using stdpath = std::experimental::filesystem::path;
 
-class ArchivingGatewayCallbacks : public GatewayNetworkCallbacks {
-private:
+/**
+ * Callbacks that leave behind files for the Processor, and keep the archive
+ * index, <archive>/index.fkx, up to date as uploads complete.
+ */
+class PendingGatewayCallbacks : public GatewayNetworkCallbacks {
+protected:
     std::string path_;
     std::queue<stdpath> pending_;
+    ArchiveIndex index_;
+    UploadObservers observers_;
 
 public:
-    ArchivingGatewayCallbacks(std::string path) : path_(path) {
+    PendingGatewayCallbacks(std::string path) : path_(path), index_(stdpath{ path } / "index.fkx") {
     }
 
 public:
@@ -24,13 +34,74 @@ public:
         return pending_;
     }
 
+    void priority(RadioPacket &packet) override;
+
+    void observe(UploadObserver &observer) {
+        observers_.push_back(&observer);
+    }
+
+protected:
+    void indexed(const ArchiveRecord &record);
+
+    /**
+     * Wraps a newly opened writer so observers see the upload as it arrives.
+     * Returns the writer itself when nobody is observing. Collecting keeps a
+     * copy of the upload for complete(), so it needn't be read back.
+     */
+    lws::Writer *tap(lws::Writer *writer, const ArchiveRecord &record, size_t expected, bool collecting);
+    lws::Writer *target(lws::Writer *writer);
+    void untap(lws::Writer *writer);
+
+    /**
+     * Hands the stored upload to observers, either the copy tap() collected
+     * or one that's still in memory.
+     */
+    void completed(lws::Writer *writer, const stdpath &path);
+    void completed(lws::Writer *writer, const stdpath &path, const uint8_t *ptr, size_t size);
+    void aborted(lws::Writer *writer);
+
+};
+
+/**
+ * Writes each upload to its own file, archive/<nodeId>/<YYYYMMDD>/<HHMMSS>_<mmm>_fkn.fkpb
+ * Timestamps are kept unique per node so two files from one session never
+ * share a path.
+ */
+class ArchivingGatewayCallbacks : public PendingGatewayCallbacks {
+private:
+    struct Opened {
+        FileWriter *writer;
+        ArchiveRecord record;
+    };
+
+    std::map<lws::Writer*, Opened> opened_;
+    std::map<std::string, uint64_t> timestamps_;
+
+public:
+    ArchivingGatewayCallbacks(std::string path) : PendingGatewayCallbacks(path) {
+    }
+
 public:
     lws::Writer *openWriter(RadioPacket &packet) override;
-    void closeWriter(lws::Writer *writer, bool success) override;
+    bool closeWriter(lws::Writer *writer, bool success) override;
 
+};
+
+/**
+ * Appends each upload to the node's current segment in a SegmentStore.
+ * Segments are handed to the Processor once they're sealed.
+ */
+class SegmentedGatewayCallbacks : public PendingGatewayCallbacks {
 private:
-    std::string getNodeId(RadioPacket &packet);
-    stdpath getPath(RadioPacket &packet);
+    SegmentStore store_;
+
+public:
+    SegmentedGatewayCallbacks(std::string path, size_t segmentSize) : PendingGatewayCallbacks(path), store_(path, segmentSize) {
+    }
+
+public:
+    lws::Writer *openWriter(RadioPacket &packet) override;
+    bool closeWriter(lws::Writer *writer, bool success) override;
 
 };
 
@@ -2,7 +2,9 @@
 #include <cstdio>
 #include <cassert>
 #include <cstdarg>
+#include <cstring>
 #include <unistd.h>
+#include <signal.h>
 
 #include <experimental/filesystem>
 #include <string>
@@ -10,32 +12,128 @@
 #include <sstream>
 #include <iomanip>
 #include <thread>
+#include <memory>
+#include <algorithm>
 
 #include "lora_radio_pi.h"
 #include "gateway_protocol.h"
 #include "gateway_callbacks.h"
 #include "file_writer.h"
 #include "processor.h"
+#include "plugin.h"
+#include "stream_publisher.h"
+#include "storage_stage.h"
 
 constexpr uint8_t PIN_SELECT = 6;
 constexpr uint8_t PIN_DIO_0 = 7;
 constexpr uint8_t PIN_RESET = 0;
+constexpr uint32_t ReportInterval = 60 * 1000;
+constexpr uint32_t IdlePollInterval = 1000;
+constexpr uint32_t StreamPollInterval = 100;
+
+static volatile sig_atomic_t traceRequested = 0;
+
+static void requestTrace(int32_t signal) {
+    traceRequested = 1;
+}
 
 int32_t main(int32_t argc, const char **argv) {
     auto command = "";
     auto archive = "./archive";
+    auto dutyCycle = 0;
+    auto beaconPeriod = 0u;
+    auto store = std::string{ "files" };
+    auto segmentSize = SegmentStore::DefaultSegmentSize;
+    // One per core, when the core count is known.
+    auto workers = std::max(std::thread::hardware_concurrency(), 1u);
+    auto timeout = 0u;
+    auto batching = ProcessorBatching{ };
+    auto pluginPaths = std::vector<std::string>{ };
+    auto pluginArgs = "";
+    auto streamPath = "";
     for (auto i = 0; i < argc; ++i) {
         auto arg = std::string(argv[i]);
         if (arg == "--command") {
             if (i + 1 < argc) {
                 command = argv[++i];
-                slc::log() << "Using command: " << command;
+                slc::logInfo() << "Using command: " << command;
             }
         }
         if (arg == "--archive") {
             if (i + 1 < argc) {
                 archive = argv[++i];
-                slc::log() << "Using directory: " << archive;
+                slc::logInfo() << "Using directory: " << archive;
+            }
+        }
+        if (arg == "--store") {
+            if (i + 1 < argc) {
+                store = argv[++i];
+                slc::logInfo() << "Using store: " << store;
+            }
+        }
+        if (arg == "--segment-size") {
+            if (i + 1 < argc) {
+                segmentSize = std::stoul(argv[++i]) * 1024 * 1024;
+            }
+        }
+        if (arg == "--workers") {
+            if (i + 1 < argc) {
+                workers = std::stoul(argv[++i]);
+                if (workers == 0) {
+                    std::cerr << "--workers needs at least one worker" << std::endl;
+                    return 2;
+                }
+                slc::logInfo() << "Using workers: " << workers;
+            }
+        }
+        if (arg == "--timeout") {
+            if (i + 1 < argc) {
+                timeout = std::stoul(argv[++i]);
+                slc::logInfo() << "Using timeout: " << timeout << "ms";
+            }
+        }
+        if (arg == "--batch-size") {
+            if (i + 1 < argc) {
+                batching.size = std::stoul(argv[++i]);
+                slc::logInfo() << "Using batch size: " << (uint32_t)batching.size;
+            }
+        }
+        if (arg == "--batch-wait") {
+            if (i + 1 < argc) {
+                batching.wait = std::stoul(argv[++i]);
+                slc::logInfo() << "Using batch wait: " << batching.wait << "ms";
+            }
+        }
+        if (arg == "--batch-stdin") {
+            batching.viaStdin = true;
+            slc::logInfo() << "Using stdin for batches";
+        }
+        if (arg == "--plugin") {
+            if (i + 1 < argc) {
+                pluginPaths.emplace_back(argv[++i]);
+            }
+        }
+        if (arg == "--plugin-args") {
+            if (i + 1 < argc) {
+                pluginArgs = argv[++i];
+            }
+        }
+        if (arg == "--stream") {
+            if (i + 1 < argc) {
+                streamPath = argv[++i];
+                slc::logInfo() << "Using stream: " << streamPath;
+            }
+        }
+        if (arg == "--duty-cycle") {
+            if (i + 1 < argc) {
+                dutyCycle = std::stoi(argv[++i]);
+                slc::logInfo() << "Using duty cycle: " << dutyCycle << " permille";
+            }
+        }
+        if (arg == "--beacon") {
+            if (i + 1 < argc) {
+                beaconPeriod = std::stoul(argv[++i]);
+                slc::logInfo() << "Using beacon: " << beaconPeriod << "ms";
             }
         }
     }
@@ -43,36 +141,87 @@ int32_t main(int32_t argc, const char **argv) {
     wiringPiSetup();
     wiringPiSPISetup(0, 500000);
 
-    LoraRadioPi radio(PIN_SELECT, PIN_RESET, PIN_DIO_0, 0);
+    WiringPiSpiBackend spi;
+    LoraRadioPi radio(spi, PIN_SELECT, PIN_RESET, PIN_DIO_0, 0);
 
     // This is purely to ensure the mutex inside is ready. This can be forgiving
     // until you start using the heap, etc...
     radio.setup();
 
-    Processor processor{ command };
-    auto callbacks = ArchivingGatewayCallbacks{ archive };
-    auto protocol = GatewayNetworkProtocol{ radio, callbacks };
+    Processor processor{ command, workers, timeout, batching };
+    std::unique_ptr<PendingGatewayCallbacks> archiving;
+    if (store == "segments") {
+        archiving.reset(new SegmentedGatewayCallbacks{ archive, segmentSize });
+    }
+    else {
+        archiving.reset(new ArchivingGatewayCallbacks{ archive });
+    }
+    auto &callbacks = *archiving;
+
+    std::vector<std::unique_ptr<Plugin>> plugins;
+    for (auto &path : pluginPaths) {
+        plugins.emplace_back(new Plugin{ path });
+        auto &plugin = *plugins.back();
+        if (!plugin.open(pluginArgs)) {
+            return 2;
+        }
+        slc::logInfo() << "Using plugin: " << plugin.name();
+        callbacks.observe(plugin);
+    }
+
+    StreamPublisher stream{ streamPath };
+    if (strlen(streamPath) > 0) {
+        if (!stream.listen()) {
+            return 2;
+        }
+        callbacks.observe(stream);
+    }
+
+    // Frames are read by the radio's interrupt thread, replied to here and
+    // stored on the storage thread, which hands them to the Processor.
+    StorageStage storage{ callbacks, processor };
+    auto protocol = GatewayNetworkProtocol{ radio, storage };
+    protocol.dutyCycle().limit(dutyCycle);
+    protocol.beaconEvery(beaconPeriod);
 
     processor.start();
+    storage.start();
+
+    // kill -USR1 dumps the recent protocol trace.
+    signal(SIGUSR1, requestTrace);
+
+    StageStats protocolStats{ "protocol" };
+    auto reportedAt = millis();
 
     while (true) {
         radio.tick();
         protocol.tick();
+        stream.poll();
 
-        auto &incoming = radio.getIncoming();
-        if (incoming.size() > 0) {
-            auto lora = incoming.front();
-            incoming.pop();
+        LoraPacket lora;
+        if (radio.popIncoming(lora)) {
+            auto started = StageStats::clock::now();
             protocol.push(lora);
+            protocolStats.record(started);
+        }
+        else {
+            // Sleep until the radio interrupts or the protocol has something
+            // due, but keep looking in on the stream socket and the reports.
+            auto wait = protocol.nextDeadline();
+            auto cap = strlen(streamPath) > 0 ? StreamPollInterval : IdlePollInterval;
+            radio.waitForEvent(wait < cap ? wait : cap);
+        }
 
-            auto &pending = callbacks.pending();
-            while (pending.size() > 0) {
-                processor.push(pending.front());
-                pending.pop();
-            }
+        if (traceRequested) {
+            traceRequested = 0;
+            protocol.trace().dump();
+            protocol.stateStats().dump();
         }
 
-        delay(10);
+        if (millis() - reportedAt > ReportInterval) {
+            slc::logInfo() << "Pipeline: " << protocolStats.report(radio.incomingDepth()) << " " << storage.report() << " processing(depth " << (uint32_t)processor.depth() << ")";
+            reportedAt = millis();
+        }
     }
 
     return 0;
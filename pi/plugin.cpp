@@ -0,0 +1,81 @@
+#include <dlfcn.h>
+
+#include <iostream>
+
+#include "plugin.h"
+
+Plugin::~Plugin() {
+    close();
+}
+
+bool Plugin::open(const char *arguments) {
+    handle_ = dlopen(path_.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle_ == nullptr) {
+        std::cerr << "Unable to load " << path_ << ": " << dlerror() << std::endl;
+        return false;
+    }
+
+    auto entry = reinterpret_cast<slc_plugin_entry_t>(dlsym(handle_, SLC_PLUGIN_ENTRY));
+    if (entry == nullptr) {
+        std::cerr << "No " << SLC_PLUGIN_ENTRY << " in " << path_ << std::endl;
+        close();
+        return false;
+    }
+
+    plugin_ = entry();
+    if (plugin_ == nullptr || plugin_->api_version < SLC_PLUGIN_API_MINIMUM_VERSION || plugin_->api_version > SLC_PLUGIN_API_VERSION) {
+        std::cerr << "Unsupported plugin API in " << path_ << std::endl;
+        plugin_ = nullptr;
+        close();
+        return false;
+    }
+
+    if (plugin_->open != nullptr) {
+        state_ = plugin_->open(arguments != nullptr ? arguments : "");
+    }
+
+    return true;
+}
+
+void Plugin::close() {
+    if (plugin_ != nullptr && plugin_->close != nullptr) {
+        plugin_->close(state_);
+    }
+    plugin_ = nullptr;
+    state_ = nullptr;
+    if (handle_ != nullptr) {
+        dlclose(handle_);
+        handle_ = nullptr;
+    }
+}
+
+void Plugin::begin(const Upload &upload) {
+    if (plugin_ != nullptr && plugin_->begin != nullptr) {
+        plugin_->begin(state_, &upload);
+    }
+}
+
+void Plugin::chunk(const Upload &upload, const uint8_t *ptr, size_t size) {
+    if (plugin_ != nullptr && plugin_->chunk != nullptr) {
+        plugin_->chunk(state_, &upload, ptr, size);
+    }
+}
+
+void Plugin::complete(const Upload &upload, const char *path, const uint8_t *ptr, size_t size) {
+    if (plugin_ != nullptr && plugin_->complete != nullptr) {
+        plugin_->complete(state_, &upload, path, ptr, size);
+    }
+}
+
+void Plugin::aborted(const Upload &upload) {
+    if (plugin_ != nullptr && plugin_->aborted != nullptr) {
+        plugin_->aborted(state_, &upload);
+    }
+}
+
+void Plugin::priority(const Upload &upload, const uint8_t *ptr, size_t size) {
+    // Older tables don't have the field at all.
+    if (plugin_ != nullptr && plugin_->api_version >= 2 && plugin_->priority != nullptr) {
+        plugin_->priority(state_, &upload, ptr, size);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef SLC_PLUGIN_H_INCLUDED
+#define SLC_PLUGIN_H_INCLUDED
+
+#include <string>
+
+#include "upload_observer.h"
+
+/**
+ * A plugin loaded from a shared library, see plugin_api.h
+ */
+class Plugin : public UploadObserver {
+private:
+    std::string path_;
+    void *handle_{ nullptr };
+    const slc_plugin_t *plugin_{ nullptr };
+    void *state_{ nullptr };
+
+public:
+    Plugin(std::string path) : path_(path) {
+    }
+
+    virtual ~Plugin();
+
+public:
+    bool open(const char *arguments);
+    void close();
+
+    const char *name() {
+        return plugin_ != nullptr && plugin_->name != nullptr ? plugin_->name : path_.c_str();
+    }
+
+public:
+    void begin(const Upload &upload) override;
+    void chunk(const Upload &upload, const uint8_t *ptr, size_t size) override;
+    void complete(const Upload &upload, const char *path, const uint8_t *ptr, size_t size) override;
+    void aborted(const Upload &upload) override;
+    void priority(const Upload &upload, const uint8_t *ptr, size_t size) override;
+
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SLC_PLUGIN_API_H_INCLUDED
+#define SLC_PLUGIN_API_H_INCLUDED
+
+/**
+ * The C ABI for gateway plugins, loaded with --plugin. A plugin is a shared
+ * library exporting slc_plugin_entry(), which returns a table of callbacks.
+ * Any callback may be NULL.
+ *
+ * open and close are called from the gateway's main thread, at startup and
+ * shutdown. begin, chunk, complete, aborted and priority are all called from
+ * the storage thread, one at a time and in order, so a plugin doesn't need
+ * to be thread safe between them. They hold up storing the next frame, so
+ * they should return quickly. chunk is handed a copy of the DATA taken off
+ * the storage queue, not the radio's buffer. Pointers handed to a callback
+ * are only valid until it returns.
+ *
+ * Tables from version 1 plugins end before priority, which the gateway
+ * treats as NULL for them.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SLC_PLUGIN_API_VERSION 2
+/* The oldest version the gateway still loads. */
+#define SLC_PLUGIN_API_MINIMUM_VERSION 1
+
+typedef struct slc_upload_t {
+    uint8_t node_id[8];
+    /* Milliseconds since the epoch when the upload started. */
+    uint64_t timestamp;
+    /* Size the node announced, may be 0. */
+    uint32_t expected;
+} slc_upload_t;
+
+typedef struct slc_plugin_t {
+    /* SLC_PLUGIN_API_VERSION the plugin was built against. */
+    uint32_t api_version;
+    const char *name;
+
+    /* Returns the plugin's state, passed to every other callback. Returning
+     * NULL is allowed. Arguments are from --plugin-args, or "". */
+    void *(*open)(const char *arguments);
+    void (*close)(void *state);
+
+    /* An upload has started. */
+    void (*begin)(void *state, const slc_upload_t *upload);
+
+    /* DATA from the node, as it arrives. */
+    void (*chunk)(void *state, const slc_upload_t *upload, const uint8_t *ptr, size_t size);
+
+    /* The whole upload, once it's safely stored at path. */
+    void (*complete)(void *state, const slc_upload_t *upload, const char *path, const uint8_t *ptr, size_t size);
+
+    /* The upload failed and nothing was stored. */
+    void (*aborted)(void *state, const slc_upload_t *upload);
+
+    /* A PRIORITY message, outside of any upload. expected is its size and
+     * timestamp when it arrived. Version 2 and later. */
+    void (*priority)(void *state, const slc_upload_t *upload, const uint8_t *ptr, size_t size);
+} slc_plugin_t;
+
+typedef const slc_plugin_t *(*slc_plugin_entry_t)(void);
+
+#define SLC_PLUGIN_ENTRY "slc_plugin_entry"
+
+const slc_plugin_t *slc_plugin_entry(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
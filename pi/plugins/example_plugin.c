@@ -0,0 +1,65 @@
+/**
+ * A minimal gateway plugin that logs each upload it sees, see plugin_api.h
+ *
+ * gcc -shared -fPIC -I.. -o libslc-example-plugin.so example_plugin.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plugin_api.h"
+
+typedef struct example_state_t {
+    size_t chunks;
+    size_t bytes;
+} example_state_t;
+
+static void *example_open(const char *arguments) {
+    fprintf(stderr, "example: open '%s'\n", arguments);
+    return calloc(1, sizeof(example_state_t));
+}
+
+static void example_close(void *state) {
+    free(state);
+}
+
+static void example_begin(void *state, const slc_upload_t *upload) {
+    example_state_t *example = (example_state_t *)state;
+    example->chunks = 0;
+    example->bytes = 0;
+}
+
+static void example_chunk(void *state, const slc_upload_t *upload, const uint8_t *ptr, size_t size) {
+    example_state_t *example = (example_state_t *)state;
+    example->chunks++;
+    example->bytes += size;
+}
+
+static void example_complete(void *state, const slc_upload_t *upload, const char *path, const uint8_t *ptr, size_t size) {
+    example_state_t *example = (example_state_t *)state;
+    fprintf(stderr, "example: %s %zu bytes (%zu streamed in %zu chunks)\n", path, size, example->bytes, example->chunks);
+}
+
+static void example_aborted(void *state, const slc_upload_t *upload) {
+    fprintf(stderr, "example: aborted\n");
+}
+
+static void example_priority(void *state, const slc_upload_t *upload, const uint8_t *ptr, size_t size) {
+    fprintf(stderr, "example: priority %zu bytes\n", size);
+}
+
+static const slc_plugin_t example_plugin = {
+    SLC_PLUGIN_API_VERSION,
+    "example",
+    example_open,
+    example_close,
+    example_begin,
+    example_chunk,
+    example_complete,
+    example_aborted,
+    example_priority,
+};
+
+__attribute__((visibility("default")))
+const slc_plugin_t *slc_plugin_entry(void) {
+    return &example_plugin;
+}
@@ -1,61 +1,93 @@
 #include <iostream>
 #include <string>
+#include <chrono>
 
 #include "processor.h"
 #include "packet_radio.h"
 
-class ProcessMonitor {
-private:
-    Logger log{ "Process "};
-
-public:
-    bool runSynchronously(std::string cmdline) {
-        auto stream = popen(cmdline.c_str(), "r");
-        if (stream == nullptr) {
-            return false;
+static std::string quote(const std::string &value) {
+    std::string quoted = "'";
+    for (auto c : value) {
+        if (c == '\'') {
+            quoted += "'\\''";
+        }
+        else {
+            quoted += c;
         }
+    }
+    quoted += "'";
+    return quoted;
+}
 
-        char buffer[256] = { 0 };
-        while (NULL != fgets(buffer, sizeof(buffer) - 1, stream)) {
-            std::string line(buffer);
-            auto trimmed = line.substr(0, line.find_last_not_of("\n") + 1);
-            log() << trimmed;
+void Processor::operator()() {
+    using clock = std::chrono::steady_clock;
+
+    while (true) {
+        std::vector<stdpath> batch;
+        stdpath first;
+        if (!queue_.pop(first)) {
+            break;
         }
+        batch.emplace_back(std::move(first));
+        collecting_ = batch.size();
 
-        if (feof(stream)) {
-            slc::log() << "Command finished";
+        // Whatever's already waiting goes in regardless of --batch-wait.
+        while (batch.size() < batching_.size) {
+            stdpath path;
+            if (!queue_.try_pop(path)) {
+                break;
+            }
+            batch.emplace_back(std::move(path));
+            collecting_ = batch.size();
         }
 
-        auto status = pclose(stream);
-        if (status == -1) {
-            log() << "Command finished in error";
-            return false;
+        auto deadline = clock::now() + std::chrono::milliseconds(batching_.wait);
+        while (batch.size() < batching_.size) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+            if (remaining.count() <= 0) {
+                break;
+            }
+            stdpath path;
+            if (!queue_.pop(path, remaining)) {
+                break;
+            }
+            batch.emplace_back(std::move(path));
+            collecting_ = batch.size();
         }
 
-        return true;
+        run(batch);
+        collecting_ = 0;
     }
+}
 
-};
-
-void Processor::operator()() {
-    while (true) {
-        auto path = queue_.pop();
-
-        slc::log() << "Processing " << path.c_str();
+void Processor::run(std::vector<stdpath> &batch) {
+    for (auto &path : batch) {
+        slc::logInfo() << "Processing " << path.c_str();
+    }
 
-        if (command_.size() > 0) {
-            auto running = command_;
-            running += " ";
-            running += path;
-            running += " 2>&1";
+    if (command_.size() == 0) {
+        return;
+    }
 
-            slc::log() << "Running " << running;
-            auto process = ProcessMonitor();
-            process.runSynchronously(running);
+    auto job = WorkerJob{ command_, nullptr, "" };
+    for (auto &path : batch) {
+        if (batching_.viaStdin) {
+            job.input += path.string();
+            job.input += "\n";
         }
+        else {
+            job.command += " ";
+            job.command += quote(path.string());
+        }
+    }
+
+    if (batch.size() > 1) {
+        slc::logInfo() << "Batched " << (uint32_t)batch.size() << " files";
     }
+
+    pool_.submit(std::move(job));
 }
 
 void Processor::push(stdpath path) {
-    queue_.push(path);
+    queue_.push(std::move(path));
 }
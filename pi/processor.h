@@ -3,31 +3,82 @@
 
 #include <experimental/filesystem>
 #include <thread>
+#include <atomic>
+#include <vector>
 
 #include "queue.h"
+#include "worker_pool.h"
 
 using stdpath = std::experimental::filesystem::path;
 
+/**
+ * How completed files are grouped into command invocations. The defaults
+ * run the command once per file, as soon as it's ready.
+ */
+struct ProcessorBatching {
+    // Most files handed to one invocation.
+    size_t size{ 1 };
+    // How long to wait for more files after the first, in ms.
+    uint32_t wait{ 0 };
+    // Write the paths to the command's stdin, one per line, instead of
+    // passing them as arguments.
+    bool viaStdin{ false };
+};
+
 class Processor {
 private:
     std::string command_;
+    ProcessorBatching batching_;
     ConcurrentQueue<stdpath> queue_;
+    WorkerPool pool_;
+    std::thread thread_;
+    // Files taken off queue_ while a batch is collected.
+    std::atomic<size_t> collecting_{ 0 };
+
+public:
+    Processor(std::string command, size_t workers = 1, uint32_t timeout = 0, ProcessorBatching batching = ProcessorBatching{ })
+        : command_(command), batching_(batching), pool_(workers, timeout) {
+    }
 
 public:
-    Processor(std::string command) : command_(command) {
+    ~Processor() {
+        stop();
     }
 
 public:
     void start() {
-        std::thread thread(std::ref(*this));
-        thread.detach();
+        pool_.start();
+        thread_ = std::thread(std::ref(*this));
+    }
+
+    /**
+     * Stops taking files, hands whatever was queued to the pool and then
+     * stops the pool, which kills any command still running.
+     */
+    void stop() {
+        queue_.close();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        pool_.stop();
     }
 
     void push(stdpath path);
 
+    /**
+     * Completed uploads waiting for a worker, whether still queued, being
+     * batched or waiting in the pool.
+     */
+    size_t depth() {
+        return queue_.size() + collecting_ + pool_.depth();
+    }
+
 public:
     void operator()();
 
+private:
+    void run(std::vector<stdpath> &batch);
+
 };
 
 #endif
@@ -4,6 +4,18 @@
 #include <mutex>
 #include <condition_variable>
 #include <queue>
+#include <vector>
+#include <chrono>
+
+/**
+ * What push() does when a bounded queue is full.
+ */
+enum class QueueFull {
+    // Wait for a consumer to make room.
+    Block,
+    // Give up on the new item and count it as dropped.
+    Drop,
+};
 
 template<typename T>
 class ConcurrentQueue {
@@ -11,28 +23,140 @@ private:
     std::queue<T> queue_;
     std::mutex mutex_;
     std::condition_variable ready_;
+    std::condition_variable space_;
+    size_t capacity_{ 0 };
+    QueueFull full_{ QueueFull::Block };
+    size_t dropped_{ 0 };
+    bool closed_{ false };
 
 public:
-    ConcurrentQueue() = default;
+    /**
+     * A capacity of 0 is unbounded.
+     */
+    ConcurrentQueue(size_t capacity = 0, QueueFull full = QueueFull::Block) : capacity_(capacity), full_(full) {
+    }
+
     ConcurrentQueue(const ConcurrentQueue&) = delete;
     ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
 
 public:
-    T pop() {
+    /**
+     * Waits for an item, returning false once the queue is closed and empty.
+     */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        ready_.wait(mlock, [this] { return !queue_.empty() || closed_; });
+        return take(mlock, item);
+    }
+
+    /**
+     * Waits up to timeout for an item, returning false if none arrived.
+     */
+    bool pop(T &item, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        ready_.wait_for(mlock, timeout, [this] { return !queue_.empty() || closed_; });
+        return take(mlock, item);
+    }
+
+    bool try_pop(T &item) {
         std::unique_lock<std::mutex> mlock(mutex_);
-        while (queue_.empty()) {
-            ready_.wait(mlock);
+        return take(mlock, item);
+    }
+
+    /**
+     * Waits for at least one item and then moves everything queued onto the
+     * end of items, under a single lock. Returns how many were taken, 0 once
+     * the queue is closed and empty.
+     */
+    size_t pop_all(std::vector<T> &items) {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        ready_.wait(mlock, [this] { return !queue_.empty() || closed_; });
+        auto taken = queue_.size();
+        while (!queue_.empty()) {
+            items.emplace_back(std::move(queue_.front()));
+            queue_.pop();
         }
-        auto val = queue_.front();
-        queue_.pop();
-        return val;
+        mlock.unlock();
+        if (taken > 0 && capacity_ > 0) {
+            space_.notify_all();
+        }
+        return taken;
+    }
+
+    /**
+     * Returns false if the item was dropped or the queue is closed.
+     */
+    bool push(T &&item) {
+        return emplace(std::move(item));
     }
 
-    void push(const T& item) {
+    bool push(const T &item) {
+        return emplace(item);
+    }
+
+    template<typename... Args>
+    bool emplace(Args&&... args) {
         std::unique_lock<std::mutex> mlock(mutex_);
-        queue_.push(item);
+        if (!room(mlock)) {
+            return false;
+        }
+        queue_.emplace(std::forward<Args>(args)...);
         mlock.unlock();
         ready_.notify_one();
+        return true;
+    }
+
+    /**
+     * Wakes everyone waiting. Pushes fail from now on, and pops fail once
+     * whatever is left has been taken.
+     */
+    void close() {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        closed_ = true;
+        mlock.unlock();
+        ready_.notify_all();
+        space_.notify_all();
+    }
+
+public:
+    bool closed() {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        return closed_;
+    }
+
+    size_t size() {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        return queue_.size();
+    }
+
+    size_t dropped() {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        return dropped_;
+    }
+
+private:
+    bool take(std::unique_lock<std::mutex> &mlock, T &item) {
+        if (queue_.empty()) {
+            return false;
+        }
+        item = std::move(queue_.front());
+        queue_.pop();
+        mlock.unlock();
+        if (capacity_ > 0) {
+            space_.notify_one();
+        }
+        return true;
+    }
+
+    bool room(std::unique_lock<std::mutex> &mlock) {
+        if (capacity_ > 0 && queue_.size() >= capacity_ && !closed_) {
+            if (full_ == QueueFull::Drop) {
+                dropped_++;
+                return false;
+            }
+            space_.wait(mlock, [this] { return queue_.size() < capacity_ || closed_; });
+        }
+        return !closed_;
     }
 
 };
@@ -0,0 +1,233 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "segment_store.h"
+#include "logging.h"
+
+namespace fs = std::experimental::filesystem;
+
+static bool writeFully(int32_t fd, const uint8_t *ptr, size_t size) {
+    while (size > 0) {
+        auto bytes = ::write(fd, ptr, size);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ptr += bytes;
+        size -= bytes;
+    }
+    return true;
+}
+
+static uint64_t fileSize(int32_t fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return 0;
+    }
+    return (uint64_t)st.st_size;
+}
+
+static bool readFully(int32_t fd, uint8_t *ptr, size_t size, uint64_t offset) {
+    while (size > 0) {
+        auto bytes = ::pread(fd, ptr, size, offset);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (bytes == 0) {
+            return false;
+        }
+        ptr += bytes;
+        size -= bytes;
+        offset += bytes;
+    }
+    return true;
+}
+
+SegmentStore::SegmentStore(stdpath path, size_t segmentSize) : path_(path), segmentSize_(segmentSize) {
+}
+
+stdpath SegmentStore::segmentPath(const uint8_t *nodeId, uint32_t number) {
+    return segmentArchivePath(path_.string(), nodeId, number);
+}
+
+bool SegmentStore::segmentNumber(const stdpath &path, uint32_t &number) {
+    if (path.extension() != ".fks") {
+        return false;
+    }
+    // Anything else that happens to end in .fks isn't ours.
+    auto stem = path.stem().string();
+    char *parsed = nullptr;
+    number = (uint32_t)strtoul(stem.c_str(), &parsed, 10);
+    return !stem.empty() && *parsed == 0;
+}
+
+SegmentStore::OpenSegment &SegmentStore::current(const std::string &node) {
+    auto it = segments_.find(node);
+    if (it != segments_.end()) {
+        return it->second;
+    }
+
+    // First upload from this node since we started, pick up where the last
+    // run left off.
+    auto segment = OpenSegment{ 1, 0 };
+    auto directory = path_ / node;
+    if (fs::exists(directory)) {
+        for (auto &entry : fs::directory_iterator(directory)) {
+            auto &path = entry.path();
+            uint32_t number;
+            if (!segmentNumber(path, number)) {
+                continue;
+            }
+            if (number >= segment.number) {
+                segment.number = number;
+                segment.size = fs::file_size(path);
+            }
+        }
+    }
+
+    return segments_[node] = segment;
+}
+
+bool SegmentStore::append(NodeLoraId &nodeId, uint64_t timestamp, uint8_t *ptr, size_t size, ArchiveRecord &record) {
+    auto &segment = current(toHex(nodeId));
+    auto recordSize = sizeof(SegmentHeader) + size;
+
+    if (segment.size > 0 && segment.size + recordSize > segmentSize_) {
+        sealed_.emplace(segmentPath(nodeId.ptr, segment.number));
+        segment.number++;
+        segment.size = 0;
+    }
+
+    auto path = segmentPath(nodeId.ptr, segment.number);
+    auto directory = path.parent_path();
+    if (!fs::exists(directory)) {
+        if (!fs::create_directories(directory)) {
+            std::cerr << "Unable to create directories: " << directory << std::endl;
+            return false;
+        }
+    }
+
+    auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Unable to open: " << path << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    auto offset = (uint64_t)lseek(fd, 0, SEEK_END);
+
+    SegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RecordMagic;
+    header.length = size;
+    header.crc = crc32(0, ptr, size);
+    header.timestamp = timestamp;
+    memcpy(header.nodeId, nodeId.ptr, sizeof(header.nodeId));
+
+    auto success = writeFully(fd, (uint8_t *)&header, sizeof(header)) && writeFully(fd, ptr, size) && fsync(fd) == 0;
+    if (!success) {
+        std::cerr << "Unable to append: " << path << " (" << strerror(errno) << ")" << std::endl;
+        // Don't leave a torn record for the next append to follow.
+        if (ftruncate(fd, offset) != 0) {
+            std::cerr << "Unable to truncate: " << path << std::endl;
+        }
+        ::close(fd);
+        return false;
+    }
+
+    ::close(fd);
+
+    segment.size = offset + recordSize;
+
+    memset(&record, 0, sizeof(record));
+    memcpy(record.nodeId, nodeId.ptr, sizeof(record.nodeId));
+    record.timestamp = timestamp;
+    record.segment = segment.number;
+    record.length = size;
+    record.offset = offset;
+    record.crc = header.crc;
+
+    slc::logInfo() << "Appended " << (uint32_t)size << " bytes to " << path.c_str() << " @ " << (uint32_t)offset;
+
+    return true;
+}
+
+bool SegmentStore::read(const ArchiveRecord &record, std::vector<uint8_t> &data) {
+    auto path = segmentPath(record.nodeId, record.segment);
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    SegmentHeader header;
+    auto success = readFully(fd, (uint8_t *)&header, sizeof(header), record.offset);
+    if (success) {
+        success = header.magic == RecordMagic && header.length == record.length &&
+            header.length <= fileSize(fd) - record.offset - sizeof(header);
+    }
+    if (success) {
+        data.resize(header.length);
+        success = readFully(fd, data.data(), header.length, record.offset + sizeof(header));
+    }
+    if (success) {
+        success = crc32(0, data.data(), data.size()) == header.crc;
+    }
+
+    ::close(fd);
+
+    return success;
+}
+
+bool SegmentStore::scan(stdpath segment, std::function<bool(SegmentHeader&, uint64_t, std::vector<uint8_t>&)> callback) {
+    auto fd = ::open(segment.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+    uint64_t offset = 0;
+    auto size = fileSize(fd);
+    auto success = true;
+
+    while (true) {
+        SegmentHeader header;
+        if (!readFully(fd, (uint8_t *)&header, sizeof(header), offset)) {
+            break;
+        }
+        if (header.magic != RecordMagic) {
+            success = false;
+            break;
+        }
+        // A torn or corrupt header, don't go allocating whatever it says.
+        if (header.length > size - offset - sizeof(header)) {
+            success = false;
+            break;
+        }
+        data.resize(header.length);
+        if (!readFully(fd, data.data(), header.length, offset + sizeof(header))) {
+            success = false;
+            break;
+        }
+        if (crc32(0, data.data(), data.size()) != header.crc) {
+            success = false;
+            break;
+        }
+        if (!callback(header, offset, data)) {
+            break;
+        }
+        offset += sizeof(header) + header.length;
+    }
+
+    ::close(fd);
+
+    return success;
+}
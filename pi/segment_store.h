@@ -0,0 +1,94 @@
+#ifndef SLC_SEGMENT_STORE_H_INCLUDED
+#define SLC_SEGMENT_STORE_H_INCLUDED
+
+#include <experimental/filesystem>
+#include <functional>
+#include <string>
+#include <queue>
+#include <map>
+#include <vector>
+
+#include "archive_record.h"
+
+using stdpath = std::experimental::filesystem::path;
+
+/**
+ * Precedes every upload in a segment file, so a segment can be scanned
+ * front to back without the index.
+ */
+struct __attribute__((packed)) SegmentHeader {
+    uint32_t magic;
+    uint32_t length;
+    uint32_t crc;
+    uint32_t reserved;
+    uint64_t timestamp;
+    uint8_t nodeId[8];
+};
+
+static_assert(sizeof(SegmentHeader) == 32, "SegmentHeader is part of the on disk format");
+
+/**
+ * Append only archive. Each upload becomes one framed record appended to
+ * the node's current segment, <path>/<nodeId>/<number>.fks, and segments
+ * are sealed and a new one started once they reach the configured size.
+ * append() fills in the record for the caller to index, segments are only
+ * scanned to rebuild the index.
+ */
+class SegmentStore {
+public:
+    static constexpr uint32_t RecordMagic = 0x31534b46; // FKS1
+    static constexpr size_t DefaultSegmentSize = 64 * 1024 * 1024;
+
+private:
+    struct OpenSegment {
+        uint32_t number;
+        uint64_t size;
+    };
+
+    stdpath path_;
+    size_t segmentSize_;
+    std::map<std::string, OpenSegment> segments_;
+    std::queue<stdpath> sealed_;
+
+public:
+    SegmentStore(stdpath path, size_t segmentSize = DefaultSegmentSize);
+
+public:
+    bool append(NodeLoraId &nodeId, uint64_t timestamp, uint8_t *ptr, size_t size, ArchiveRecord &record);
+
+    /**
+     * Segments that have been filled and will not be written again.
+     */
+    std::queue<stdpath> &sealed() {
+        return sealed_;
+    }
+
+public:
+    size_t segmentSize() {
+        return segmentSize_;
+    }
+
+    stdpath segmentPath(const uint8_t *nodeId, uint32_t number);
+
+    /**
+     * The number of the segment at path, false if it isn't one of ours.
+     */
+    static bool segmentNumber(const stdpath &path, uint32_t &number);
+
+    /**
+     * Reads the upload a record refers to, verifying its checksum.
+     */
+    bool read(const ArchiveRecord &record, std::vector<uint8_t> &data);
+
+    /**
+     * Walks every record in a single segment file, stopping early if the
+     * callback returns false or at the first damaged record.
+     */
+    static bool scan(stdpath segment, std::function<bool(SegmentHeader&, uint64_t, std::vector<uint8_t>&)> callback);
+
+private:
+    OpenSegment &current(const std::string &node);
+
+};
+
+#endif
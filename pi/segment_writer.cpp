@@ -0,0 +1,26 @@
+#include <algorithm>
+
+#include "segment_writer.h"
+
+SegmentWriter::SegmentWriter(SegmentStore &store, NodeLoraId &nodeId, uint64_t timestamp, size_t expected)
+    : store_(&store), nodeId_(nodeId), timestamp_(timestamp) {
+    // Only a hint, so never more than a segment's worth whatever PREPARE said.
+    buffer_.reserve(std::min(expected, store.segmentSize()));
+}
+
+int32_t SegmentWriter::write(uint8_t *ptr, size_t size) {
+    buffer_.insert(buffer_.end(), ptr, ptr + size);
+    return size;
+}
+
+int32_t SegmentWriter::write(uint8_t byte) {
+    buffer_.push_back(byte);
+    return 1;
+}
+
+void SegmentWriter::close() {
+}
+
+bool SegmentWriter::commit(ArchiveRecord &record) {
+    return store_->append(nodeId_, timestamp_, buffer_.data(), buffer_.size(), record);
+}
@@ -0,0 +1,37 @@
+#ifndef SLC_SEGMENT_WRITER_H_INCLUDED
+#define SLC_SEGMENT_WRITER_H_INCLUDED
+
+#include <lwstreams/lwstreams.h>
+
+#include <vector>
+
+#include "segment_store.h"
+
+/**
+ * Collects an upload in memory and appends it to a SegmentStore as a single
+ * record on commit(), so a failed upload never touches the store.
+ */
+class SegmentWriter : public lws::Writer {
+private:
+    SegmentStore *store_;
+    NodeLoraId nodeId_;
+    uint64_t timestamp_;
+    std::vector<uint8_t> buffer_;
+
+public:
+    SegmentWriter(SegmentStore &store, NodeLoraId &nodeId, uint64_t timestamp, size_t expected);
+
+public:
+    int32_t write(uint8_t *ptr, size_t size) override;
+    int32_t write(uint8_t byte) override;
+    void close() override;
+
+    bool commit(ArchiveRecord &record);
+
+    const std::vector<uint8_t> &buffer() {
+        return buffer_;
+    }
+
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SLC_STAGE_STATS_H_INCLUDED
+#define SLC_STAGE_STATS_H_INCLUDED
+
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <sstream>
+
+/**
+ * Latency of one stage of the gateway pipeline, reset each time it's
+ * reported so the numbers cover the last interval.
+ */
+class StageStats {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    std::string name_;
+    std::mutex mutex_;
+    uint32_t count_{ 0 };
+    uint64_t total_{ 0 };
+    uint64_t maximum_{ 0 };
+
+public:
+    StageStats(std::string name) : name_(name) {
+    }
+
+public:
+    void record(clock::time_point started) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - started).count();
+        std::lock_guard<std::mutex> lock(mutex_);
+        count_++;
+        total_ += elapsed;
+        if ((uint64_t)elapsed > maximum_) {
+            maximum_ = elapsed;
+        }
+    }
+
+    /**
+     * Summarizes and resets, eg: storage(depth 3, 120 ops, avg 1.2ms, max 40.1ms)
+     */
+    std::string report(size_t depth) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::stringstream ss;
+        ss.precision(1);
+        ss << std::fixed << name_ << "(depth " << depth << ", " << count_ << " ops";
+        if (count_ > 0) {
+            ss << ", avg " << (total_ / count_) / 1000.0 << "ms, max " << maximum_ / 1000.0 << "ms";
+        }
+        ss << ")";
+        count_ = 0;
+        total_ = 0;
+        maximum_ = 0;
+        return ss.str();
+    }
+
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "storage_stage.h"
+
+int32_t AsyncWriter::write(uint8_t *ptr, size_t size) {
+    if (stage_->failed(upload_)) {
+        return 0;
+    }
+    stage_->write(upload_, ptr, size);
+    return size;
+}
+
+int32_t AsyncWriter::write(uint8_t byte) {
+    return write(&byte, 1);
+}
+
+void AsyncWriter::close() {
+}
+
+lws::Writer *StorageStage::openWriter(RadioPacket &packet) {
+    auto upload = ++uploads_;
+    queue_.push(Operation{ Operation::Kind::Open, upload, packet.getNodeId(), packet.m().size, { }, false, StageStats::clock::now() });
+    return new AsyncWriter(*this, upload);
+}
+
+bool StorageStage::closeWriter(lws::Writer *writer, bool success) {
+    if (writer == nullptr) {
+        return false;
+    }
+
+    auto async = reinterpret_cast<AsyncWriter*>(writer);
+    auto upload = async->upload();
+    queue_.push(Operation{ Operation::Kind::Close, upload, { }, 0, { }, success, StageStats::clock::now() });
+    delete async;
+
+    if (!success) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    closed_.wait(lock, [&] { return stored_.count(upload) > 0 || stopped_; });
+    auto iter = stored_.find(upload);
+    if (iter == stored_.end()) {
+        return false;
+    }
+    auto stored = iter->second;
+    stored_.erase(iter);
+    return stored;
+}
+
+void StorageStage::priority(RadioPacket &packet) {
+    auto data = packet.data();
+    queue_.push(Operation{ Operation::Kind::Priority, 0, packet.getNodeId(), 0, std::vector<uint8_t>(data.ptr, data.ptr + data.size), false, StageStats::clock::now() });
+}
+
+void StorageStage::write(uint32_t upload, uint8_t *ptr, size_t size) {
+    queue_.push(Operation{ Operation::Kind::Write, upload, { }, 0, std::vector<uint8_t>(ptr, ptr + size), false, StageStats::clock::now() });
+}
+
+bool StorageStage::failed(uint32_t upload) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_.count(upload) > 0;
+}
+
+void StorageStage::fail(uint32_t upload) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed_.insert(upload);
+}
+
+void StorageStage::finished(uint32_t upload, bool waiting, bool stored) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_.erase(upload);
+        if (waiting) {
+            stored_[upload] = stored;
+        }
+    }
+    closed_.notify_all();
+}
+
+void StorageStage::operator()() {
+    Operation op;
+    while (queue_.pop(op)) {
+        perform(op);
+        stats_.record(op.queued);
+
+        auto &pending = target_->pending();
+        while (!pending.empty()) {
+            processor_->push(pending.front());
+            pending.pop();
+        }
+    }
+
+    for (auto &pair : writers_) {
+        if (pair.second != nullptr) {
+            pair.second->close();
+        }
+        target_->closeWriter(pair.second, false);
+    }
+    writers_.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    closed_.notify_all();
+}
+
+void StorageStage::perform(Operation &op) {
+    switch (op.kind) {
+    case Operation::Kind::Open: {
+        auto packet = RadioPacket{ fk_radio_PacketKind_PREPARE, op.nodeId };
+        packet.m().size = op.size;
+        auto writer = target_->openWriter(packet);
+        if (writer == nullptr) {
+            fail(op.upload);
+        }
+        writers_[op.upload] = writer;
+        break;
+    }
+    case Operation::Kind::Write: {
+        auto iter = writers_.find(op.upload);
+        if (iter == writers_.end() || iter->second == nullptr) {
+            fail(op.upload);
+            break;
+        }
+        auto written = iter->second->write(op.data.data(), op.data.size());
+        if (written != (int32_t)op.data.size()) {
+            fail(op.upload);
+        }
+        break;
+    }
+    case Operation::Kind::Close: {
+        auto stored = false;
+        auto iter = writers_.find(op.upload);
+        if (iter != writers_.end()) {
+            auto success = op.success && !failed(op.upload);
+            // The DownloadTracker only closes writers it's abandoning.
+            if (iter->second != nullptr && !success) {
+                iter->second->close();
+            }
+            stored = target_->closeWriter(iter->second, success);
+            writers_.erase(iter);
+        }
+        finished(op.upload, op.success, stored);
+        break;
+    }
+    case Operation::Kind::Priority: {
+        auto packet = RadioPacket{ fk_radio_PacketKind_PRIORITY, op.nodeId };
+        packet.data(op.data.data(), op.data.size());
+        target_->priority(packet);
+        break;
+    }
+    }
+}
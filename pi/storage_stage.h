@@ -0,0 +1,135 @@
+#ifndef SLC_STORAGE_STAGE_H_INCLUDED
+#define SLC_STORAGE_STAGE_H_INCLUDED
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "gateway_callbacks.h"
+#include "processor.h"
+#include "queue.h"
+#include "stage_stats.h"
+
+class StorageStage;
+
+/**
+ * Handed to the DownloadTracker in place of the real writer. Writes are
+ * copied onto the storage queue and return immediately, or return 0 once
+ * the storage thread has failed to store an earlier part of the upload.
+ */
+class AsyncWriter : public lws::Writer {
+private:
+    StorageStage *stage_;
+    uint32_t upload_;
+
+public:
+    AsyncWriter(StorageStage &stage, uint32_t upload) : stage_(&stage), upload_(upload) {
+    }
+
+public:
+    int32_t write(uint8_t *ptr, size_t size) override;
+    int32_t write(uint8_t byte) override;
+    void close() override;
+
+    uint32_t upload() {
+        return upload_;
+    }
+
+};
+
+/**
+ * Moves all storage IO (opening, writing, fsync and renaming uploads, the
+ * archive index, plugins and streams) off the protocol thread so a slow SD
+ * card can't hold up an ACK. Operations run in order on one thread and
+ * completed uploads go straight to the Processor. PRIORITY messages are
+ * queued the same way. The one exception is a successful close, which waits for the upload to be committed because the
+ * node deletes its copy once that's ACK'd.
+ */
+class StorageStage : public GatewayNetworkCallbacks {
+public:
+    static constexpr size_t DefaultCapacity = 256;
+
+private:
+    struct Operation {
+        enum class Kind { Open, Write, Close, Priority };
+
+        Kind kind;
+        uint32_t upload;
+        NodeLoraId nodeId;
+        int32_t size;
+        std::vector<uint8_t> data;
+        bool success;
+        StageStats::clock::time_point queued;
+    };
+
+    PendingGatewayCallbacks *target_;
+    Processor *processor_;
+    ConcurrentQueue<Operation> queue_;
+    std::thread thread_;
+    std::map<uint32_t, lws::Writer*> writers_;
+    uint32_t uploads_{ 0 };
+    // Shared with the protocol thread. Uploads the storage thread couldn't
+    // store, and the outcome of closes it's waiting on.
+    std::mutex mutex_;
+    std::condition_variable closed_;
+    std::set<uint32_t> failed_;
+    std::map<uint32_t, bool> stored_;
+    bool stopped_{ false };
+    StageStats stats_{ "storage" };
+
+public:
+    StorageStage(PendingGatewayCallbacks &target, Processor &processor, size_t capacity = DefaultCapacity)
+        : target_(&target), processor_(&processor), queue_(capacity) {
+    }
+
+    ~StorageStage() {
+        stop();
+    }
+
+public:
+    void start() {
+        thread_ = std::thread(std::ref(*this));
+    }
+
+    /**
+     * Finishes everything queued and stops.
+     */
+    void stop() {
+        queue_.close();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    std::string report() {
+        return stats_.report(queue_.size());
+    }
+
+public:
+    lws::Writer *openWriter(RadioPacket &packet) override;
+    bool closeWriter(lws::Writer *writer, bool success) override;
+
+    /**
+     * Queued like everything else, so observers and plugins never hold up
+     * the protocol thread and see PRIORITY from the storage thread too.
+     */
+    void priority(RadioPacket &packet) override;
+
+public:
+    void operator()();
+
+private:
+    friend class AsyncWriter;
+
+    void write(uint32_t upload, uint8_t *ptr, size_t size);
+    void perform(Operation &op);
+    bool failed(uint32_t upload);
+    void fail(uint32_t upload);
+    void finished(uint32_t upload, bool waiting, bool stored);
+
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+
+#include "stream_publisher.h"
+#include "packet_radio.h"
+
+StreamPublisher::~StreamPublisher() {
+    for (auto &client : clients_) {
+        ::close(client.fd);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        unlink(path_.c_str());
+    }
+}
+
+bool StreamPublisher::listen() {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path_.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path_ << std::endl;
+        return false;
+    }
+    strncpy(address.sun_path, path_.c_str(), sizeof(address.sun_path) - 1);
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        std::cerr << "Unable to create socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Left behind if we didn't exit cleanly last time.
+    unlink(path_.c_str());
+
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd_, 8) != 0) {
+        std::cerr << "Unable to listen on " << path_ << ": " << strerror(errno) << std::endl;
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void StreamPublisher::poll() {
+    if (fd_ < 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    accept();
+
+    for (auto iter = clients_.begin(); iter != clients_.end(); ) {
+        auto &client = *iter;
+        auto keep = true;
+        if (client.buffer.size() > 0) {
+            auto sent = send(client.fd, client.buffer.data(), client.buffer.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent > 0) {
+                client.buffer.erase(client.buffer.begin(), client.buffer.begin() + sent);
+            }
+            else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                keep = false;
+            }
+        }
+        if (!keep) {
+            slc::logInfo() << "Stream client disconnected";
+            ::close(client.fd);
+            iter = clients_.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+}
+
+void StreamPublisher::accept() {
+    while (true) {
+        auto fd = accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        slc::logInfo() << "Stream client connected";
+        clients_.emplace_back(Client{ fd, { } });
+    }
+}
+
+void StreamPublisher::begin(const Upload &upload) {
+    publish(StreamFrameKind::Begin, upload, nullptr, 0);
+}
+
+void StreamPublisher::chunk(const Upload &upload, const uint8_t *ptr, size_t size) {
+    publish(StreamFrameKind::Chunk, upload, ptr, size);
+}
+
+void StreamPublisher::complete(const Upload &upload, const char *path, const uint8_t *ptr, size_t size) {
+    publish(StreamFrameKind::Commit, upload, reinterpret_cast<const uint8_t*>(path), strlen(path));
+}
+
+void StreamPublisher::aborted(const Upload &upload) {
+    publish(StreamFrameKind::Abort, upload, nullptr, 0);
+}
+
+void StreamPublisher::priority(const Upload &upload, const uint8_t *ptr, size_t size) {
+    publish(StreamFrameKind::Priority, upload, ptr, size);
+}
+
+void StreamPublisher::publish(StreamFrameKind kind, const Upload &upload, const uint8_t *ptr, size_t size) {
+    if (fd_ < 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    accept();
+
+    StreamFrameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.kind = kind;
+    header.length = size;
+    memcpy(header.nodeId, upload.node_id, sizeof(header.nodeId));
+    header.timestamp = upload.timestamp;
+    header.expected = upload.expected;
+
+    for (auto iter = clients_.begin(); iter != clients_.end(); ) {
+        auto &client = *iter;
+        if (flush(client, reinterpret_cast<uint8_t*>(&header), sizeof(header)) && flush(client, ptr, size)) {
+            ++iter;
+        }
+        else {
+            slc::logInfo() << "Stream client dropped";
+            ::close(client.fd);
+            iter = clients_.erase(iter);
+        }
+    }
+}
+
+bool StreamPublisher::flush(Client &client, const uint8_t *ptr, size_t size) {
+    if (size == 0) {
+        return true;
+    }
+
+    // Only write directly when nothing is queued ahead of us, otherwise the
+    // frames would interleave.
+    if (client.buffer.empty()) {
+        auto sent = send(client.fd, ptr, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return false;
+            }
+            sent = 0;
+        }
+        ptr += sent;
+        size -= sent;
+    }
+
+    if (size > 0) {
+        if (client.buffer.size() + size > MaximumBuffered) {
+            return false;
+        }
+        client.buffer.insert(client.buffer.end(), ptr, ptr + size);
+    }
+
+    return true;
+}
@@ -0,0 +1,94 @@
+#ifndef SLC_STREAM_PUBLISHER_H_INCLUDED
+#define SLC_STREAM_PUBLISHER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+
+#include "upload_observer.h"
+
+enum class StreamFrameKind : uint32_t {
+    Begin = 1,
+    Chunk = 2,
+    Commit = 3,
+    Abort = 4,
+    Priority = 5,
+};
+
+/**
+ * Precedes every frame on the stream socket. Begin frames have no payload,
+ * Chunk frames carry the DATA, Commit frames carry the path the upload was
+ * stored at and Abort frames have no payload. Priority frames carry a
+ * PRIORITY message and belong to no upload. Little endian, as written by
+ * the gateway.
+ */
+struct __attribute__((packed)) StreamFrameHeader {
+    StreamFrameKind kind;
+    // Bytes of payload following this header.
+    uint32_t length;
+    uint8_t nodeId[8];
+    uint64_t timestamp;
+    // Size the node announced, 0 if unknown.
+    uint32_t expected;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(StreamFrameHeader) == 32, "StreamFrameHeader is part of the stream protocol");
+
+/**
+ * Publishes uploads, while they're in progress, to every client connected
+ * to a Unix stream socket. Nothing here ever blocks the radio loop: clients
+ * that fall more than MaximumBuffered behind are disconnected. Uploads are
+ * published from the storage thread while poll() runs on the radio loop.
+ */
+class StreamPublisher : public UploadObserver {
+public:
+    static constexpr size_t MaximumBuffered = 4 * 1024 * 1024;
+
+private:
+    struct Client {
+        int32_t fd;
+        std::vector<uint8_t> buffer;
+    };
+
+    std::string path_;
+    int32_t fd_{ -1 };
+    std::list<Client> clients_;
+    std::mutex mutex_;
+
+public:
+    StreamPublisher(std::string path) : path_(path) {
+    }
+
+    virtual ~StreamPublisher();
+
+public:
+    bool listen();
+
+    /**
+     * Accepts new clients and writes out anything buffered. Called from the
+     * radio loop.
+     */
+    void poll();
+
+    size_t clients() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return clients_.size();
+    }
+
+public:
+    void begin(const Upload &upload) override;
+    void chunk(const Upload &upload, const uint8_t *ptr, size_t size) override;
+    void complete(const Upload &upload, const char *path, const uint8_t *ptr, size_t size) override;
+    void aborted(const Upload &upload) override;
+    void priority(const Upload &upload, const uint8_t *ptr, size_t size) override;
+
+private:
+    void publish(StreamFrameKind kind, const Upload &upload, const uint8_t *ptr, size_t size);
+    bool flush(Client &client, const uint8_t *ptr, size_t size);
+    void accept();
+
+};
+
+#endif
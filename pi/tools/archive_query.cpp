@@ -0,0 +1,179 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "archive_index.h"
+#include "segment_store.h"
+
+namespace fs = std::experimental::filesystem;
+
+static void usage() {
+    std::cerr << "usage: archive-query [--archive <dir>] [--node <hex>] [--from <time>] [--to <time>]" << std::endl;
+    std::cerr << "       archive-query [--archive <dir>] --rebuild" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Times are seconds since the epoch or YYYY-MM-DDTHH:MM:SS in local time." << std::endl;
+    std::cerr << "--rebuild recreates index.fkx by scanning the segment store's segments." << std::endl;
+}
+
+static bool parseTime(std::string value, uint64_t &ms) {
+    std::tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (strptime(value.c_str(), "%Y-%m-%dT%H:%M:%S", &tm) != nullptr) {
+        tm.tm_isdst = -1;
+        ms = (uint64_t)mktime(&tm) * 1000;
+        return true;
+    }
+    char *end = nullptr;
+    auto seconds = strtoull(value.c_str(), &end, 10);
+    if (end == nullptr || *end != 0) {
+        return false;
+    }
+    ms = seconds * 1000;
+    return true;
+}
+
+static bool parseNode(std::string value, uint8_t *nodeId) {
+    if (value.size() != 16) {
+        return false;
+    }
+    for (auto i = 0; i < 8; ++i) {
+        char *end = nullptr;
+        auto byte = value.substr(i * 2, 2);
+        nodeId[i] = (uint8_t)strtoul(byte.c_str(), &end, 16);
+        if (*end != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print(std::string archive, const ArchiveRecord &record) {
+    std::time_t t = record.timestamp / 1000;
+    std::tm tm = *std::localtime(&t);
+    char when[32];
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    auto location = record.segment == ArchiveFileSegment ?
+        fileArchivePath(archive, record.nodeId, record.timestamp).string() :
+        segmentArchivePath(archive, record.nodeId, record.segment).string() + "@" + std::to_string(record.offset);
+
+    fprintf(stdout, "%s %s.%03u %8u %08x %s\n", toHex(record.nodeId, 8).c_str(), when,
+            (uint32_t)(record.timestamp % 1000), record.length, record.crc, location.c_str());
+}
+
+static int32_t rebuild(std::string archive, ArchiveIndex &index) {
+    if (!fs::is_directory(archive)) {
+        std::cerr << "Unable to open: " << archive << std::endl;
+        return 2;
+    }
+
+    unlink(index.path().c_str());
+    if (!index.open(true)) {
+        return 2;
+    }
+
+    auto damaged = false;
+    for (auto &node : fs::directory_iterator(archive)) {
+        if (!fs::is_directory(node.path())) {
+            continue;
+        }
+        for (auto &entry : fs::directory_iterator(node.path())) {
+            auto &path = entry.path();
+            uint32_t number;
+            if (!SegmentStore::segmentNumber(path, number)) {
+                continue;
+            }
+            auto scanned = SegmentStore::scan(path, [&](SegmentHeader &header, uint64_t offset, std::vector<uint8_t> &data) {
+                ArchiveRecord record;
+                memset(&record, 0, sizeof(record));
+                memcpy(record.nodeId, header.nodeId, sizeof(record.nodeId));
+                record.timestamp = header.timestamp;
+                record.segment = number;
+                record.length = header.length;
+                record.offset = offset;
+                record.crc = header.crc;
+                return index.append(record);
+            });
+            if (!scanned) {
+                // Everything before the damage is still indexed.
+                std::cerr << "Damaged segment: " << path << std::endl;
+                damaged = true;
+            }
+        }
+    }
+
+    if (!index.merge()) {
+        return 2;
+    }
+
+    std::cerr << "Indexed " << index.size() << " records." << std::endl;
+
+    return damaged ? 1 : 0;
+}
+
+int32_t main(int32_t argc, const char **argv) {
+    auto archive = std::string{ "./archive" };
+    auto rebuilding = false;
+    auto filtering = false;
+    uint8_t nodeId[8] = { 0 };
+    uint64_t from = 0;
+    uint64_t to = UINT64_MAX;
+
+    for (auto i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        auto hasValue = i + 1 < argc;
+        if (arg == "--archive" && hasValue) {
+            archive = argv[++i];
+        }
+        else if (arg == "--node" && hasValue) {
+            if (!parseNode(argv[++i], nodeId)) {
+                std::cerr << "Invalid node: " << argv[i] << std::endl;
+                return 2;
+            }
+            filtering = true;
+        }
+        else if (arg == "--from" && hasValue) {
+            if (!parseTime(argv[++i], from)) {
+                std::cerr << "Invalid time: " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (arg == "--to" && hasValue) {
+            if (!parseTime(argv[++i], to)) {
+                std::cerr << "Invalid time: " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (arg == "--rebuild") {
+            rebuilding = true;
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    ArchiveIndex index{ stdpath{ archive } / "index.fkx" };
+
+    if (rebuilding) {
+        return rebuild(archive, index);
+    }
+
+    if (!index.open(false)) {
+        std::cerr << "Unable to open: " << index.path() << std::endl;
+        return 2;
+    }
+
+    auto records = filtering ? index.find(nodeId, from, to) : index.find(from, to);
+    for (auto &record : records) {
+        print(archive, record);
+    }
+
+    return 0;
+}
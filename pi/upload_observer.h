@@ -0,0 +1,102 @@
+#ifndef SLC_UPLOAD_OBSERVER_H_INCLUDED
+#define SLC_UPLOAD_OBSERVER_H_INCLUDED
+
+#include <lwstreams/lwstreams.h>
+
+#include <vector>
+
+#include "plugin_api.h"
+
+using Upload = slc_upload_t;
+
+/**
+ * Told about uploads as they happen, in addition to them being stored.
+ * Everything is called from the storage thread, one call at a time.
+ */
+class UploadObserver {
+public:
+    virtual ~UploadObserver() {
+    }
+
+public:
+    virtual void begin(const Upload &upload) {
+    }
+
+    virtual void chunk(const Upload &upload, const uint8_t *ptr, size_t size) {
+    }
+
+    virtual void complete(const Upload &upload, const char *path, const uint8_t *ptr, size_t size) {
+    }
+
+    virtual void aborted(const Upload &upload) {
+    }
+
+    /**
+     * A PRIORITY message, outside of any upload, once it's been ACK'd.
+     */
+    virtual void priority(const Upload &upload, const uint8_t *ptr, size_t size) {
+    }
+
+};
+
+using UploadObservers = std::vector<UploadObserver*>;
+
+/**
+ * Passes everything written through to the target and then to the
+ * observers, straight from the caller's buffer. When collecting, it also
+ * keeps a copy for complete(), for targets that don't keep one themselves.
+ */
+class TeeWriter : public lws::Writer {
+private:
+    lws::Writer *target_;
+    UploadObservers *observers_;
+    Upload upload_;
+    bool collecting_;
+    std::vector<uint8_t> collected_;
+
+public:
+    TeeWriter(lws::Writer *target, UploadObservers &observers, Upload upload, bool collecting)
+        : target_(target), observers_(&observers), upload_(upload), collecting_(collecting) {
+        if (collecting_) {
+            collected_.reserve(upload.expected);
+        }
+    }
+
+public:
+    int32_t write(uint8_t *ptr, size_t size) override {
+        auto r = target_->write(ptr, size);
+        if (r > 0) {
+            if (collecting_) {
+                collected_.insert(collected_.end(), ptr, ptr + r);
+            }
+            for (auto observer : *observers_) {
+                observer->chunk(upload_, ptr, r);
+            }
+        }
+        return r;
+    }
+
+    int32_t write(uint8_t byte) override {
+        return write(&byte, 1);
+    }
+
+    void close() override {
+        target_->close();
+    }
+
+public:
+    lws::Writer *target() {
+        return target_;
+    }
+
+    const Upload &upload() {
+        return upload_;
+    }
+
+    std::vector<uint8_t> &collected() {
+        return collected_;
+    }
+
+};
+
+#endif
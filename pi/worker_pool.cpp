@@ -0,0 +1,375 @@
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "worker_pool.h"
+#include "packet_radio.h"
+
+extern char **environ;
+
+static Logger processLog{ "Process" };
+
+// Never a valid pid, so used to tag the wakeup descriptor in epoll.
+static constexpr uint64_t WakeupTag = 0;
+
+// Or'd with the pid to tag a child's stdin, rather than its output.
+static constexpr uint64_t InputTag = (uint64_t)1 << 32;
+
+WorkerPool::WorkerPool(size_t workers, uint32_t timeout) : workers_(workers > 0 ? workers : 1), timeout_(timeout) {
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+bool WorkerPool::start() {
+    // A command that exits without reading all of its input would otherwise
+    // take the gateway down with it.
+    signal(SIGPIPE, SIG_IGN);
+
+    epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_ < 0) {
+        slc::logErrors() << "Unable to create epoll: " << strerror(errno);
+        return false;
+    }
+
+    wakeup_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeup_ < 0) {
+        slc::logErrors() << "Unable to create eventfd: " << strerror(errno);
+        return false;
+    }
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = WakeupTag;
+    epoll_ctl(epoll_, EPOLL_CTL_ADD, wakeup_, &ev);
+
+    thread_ = std::thread(std::ref(*this));
+
+    return true;
+}
+
+void WorkerPool::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+
+    stopping_ = true;
+    wake();
+    thread_.join();
+
+    for (auto &pair : running_) {
+        kill(-pair.first, SIGKILL);
+        waitpid(pair.first, nullptr, 0);
+        if (pair.second.output >= 0) {
+            close(pair.second.output);
+        }
+        if (pair.second.input >= 0) {
+            close(pair.second.input);
+        }
+    }
+    running_.clear();
+
+    close(wakeup_);
+    close(epoll_);
+}
+
+void WorkerPool::submit(WorkerJob job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_.emplace_back(std::move(job));
+        depth_ = queued_.size();
+    }
+    wake();
+}
+
+void WorkerPool::wake() {
+    uint64_t value = 1;
+    if (write(wakeup_, &value, sizeof(value)) < 0) {
+        // Already signalled.
+    }
+}
+
+void WorkerPool::operator()() {
+    epoll_event events[16];
+
+    while (!stopping_) {
+        spawnQueued();
+
+        auto n = epoll_wait(epoll_, events, sizeof(events) / sizeof(events[0]), nextTimeout());
+        for (auto i = 0; i < n; ++i) {
+            auto tag = events[i].data.u64;
+            if (tag == WakeupTag) {
+                uint64_t value;
+                if (read(wakeup_, &value, sizeof(value)) < 0) {
+                    // Spurious.
+                }
+                continue;
+            }
+            auto it = running_.find((pid_t)(tag & ~InputTag));
+            if (it != running_.end()) {
+                if ((tag & InputTag) == InputTag) {
+                    feed(it->second);
+                }
+                else {
+                    drain(it->second);
+                }
+            }
+        }
+
+        expire();
+        reap();
+    }
+}
+
+void WorkerPool::spawnQueued() {
+    while (running_.size() < workers_) {
+        WorkerJob job;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queued_.empty()) {
+                return;
+            }
+            job = std::move(queued_.front());
+            queued_.pop_front();
+            depth_ = queued_.size();
+        }
+
+        if (!spawn(job)) {
+            WorkerResult result;
+            failed_++;
+            if (job.done) {
+                job.done(job, result);
+            }
+        }
+    }
+}
+
+bool WorkerPool::spawn(WorkerJob &job) {
+    int32_t pipes[2];
+    if (pipe2(pipes, O_CLOEXEC) != 0) {
+        slc::logErrors() << "Unable to create pipe: " << strerror(errno);
+        return false;
+    }
+
+    int32_t inputs[2] = { -1, -1 };
+    if (job.input.size() > 0) {
+        if (pipe2(inputs, O_CLOEXEC) != 0) {
+            slc::logErrors() << "Unable to create pipe: " << strerror(errno);
+            close(pipes[0]);
+            close(pipes[1]);
+            return false;
+        }
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (inputs[0] >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, inputs[0], STDIN_FILENO);
+    }
+    else {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+    posix_spawn_file_actions_adddup2(&actions, pipes[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipes[1], STDERR_FILENO);
+
+    // Own process group, so a timeout can take out anything the shell
+    // started as well.
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+
+    const char *argv[] = { "/bin/sh", "-c", job.command.c_str(), nullptr };
+
+    pid_t pid;
+    auto error = posix_spawn(&pid, "/bin/sh", &actions, &attributes, (char * const *)argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    close(pipes[1]);
+    if (inputs[0] >= 0) {
+        close(inputs[0]);
+    }
+
+    if (error != 0) {
+        slc::logErrors() << "Unable to spawn: " << job.command << " (" << strerror(error) << ")";
+        close(pipes[0]);
+        if (inputs[1] >= 0) {
+            close(inputs[1]);
+        }
+        return false;
+    }
+
+    fcntl(pipes[0], F_SETFL, fcntl(pipes[0], F_GETFL) | O_NONBLOCK);
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)pid;
+    epoll_ctl(epoll_, EPOLL_CTL_ADD, pipes[0], &ev);
+
+    if (inputs[1] >= 0) {
+        fcntl(inputs[1], F_SETFL, fcntl(inputs[1], F_GETFL) | O_NONBLOCK);
+        ev.events = EPOLLOUT;
+        ev.data.u64 = (uint64_t)pid | InputTag;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, inputs[1], &ev);
+    }
+
+    auto now = clock::now();
+    auto deadline = timeout_ > 0 ? now + std::chrono::milliseconds(timeout_) : clock::time_point::max();
+
+    slc::logInfo() << "Running " << job.command << " (pid " << (int32_t)pid << ", " << (uint32_t)depth_ << " queued)";
+
+    running_[pid] = Running{ std::move(job), pid, pipes[0], inputs[1], 0, now, deadline, false, "" };
+
+    return true;
+}
+
+void WorkerPool::drain(Running &running) {
+    char buffer[256];
+
+    while (running.output >= 0) {
+        auto bytes = read(running.output, buffer, sizeof(buffer));
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+        }
+        if (bytes <= 0) {
+            if (running.line.size() > 0) {
+                processLog() << running.line;
+                running.line.clear();
+            }
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, running.output, nullptr);
+            close(running.output);
+            running.output = -1;
+            return;
+        }
+        for (auto i = 0; i < bytes; ++i) {
+            auto c = buffer[i];
+            if (c == '\n' || running.line.size() == MaximumLineLength) {
+                processLog() << running.line;
+                running.line.clear();
+            }
+            if (c != '\n') {
+                running.line += c;
+            }
+        }
+    }
+}
+
+void WorkerPool::feed(Running &running) {
+    auto &input = running.job.input;
+
+    while (running.input >= 0 && running.inputWritten < input.size()) {
+        auto bytes = write(running.input, input.data() + running.inputWritten, input.size() - running.inputWritten);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            // Most likely EPIPE, the command isn't reading.
+            break;
+        }
+        running.inputWritten += bytes;
+    }
+
+    if (running.input >= 0) {
+        epoll_ctl(epoll_, EPOLL_CTL_DEL, running.input, nullptr);
+        close(running.input);
+        running.input = -1;
+    }
+}
+
+void WorkerPool::expire() {
+    auto now = clock::now();
+    for (auto &pair : running_) {
+        auto &running = pair.second;
+        if (!running.timedOut && now >= running.deadline) {
+            slc::logInfo() << "Timeout " << running.job.command << " (pid " << (int32_t)running.pid << ")";
+            kill(-running.pid, SIGKILL);
+            running.timedOut = true;
+        }
+    }
+}
+
+void WorkerPool::reap() {
+    for (auto it = running_.begin(); it != running_.end(); ) {
+        auto &running = it->second;
+        int32_t status = 0;
+        if (waitpid(running.pid, &status, WNOHANG) != running.pid) {
+            ++it;
+            continue;
+        }
+
+        drain(running);
+        if (running.input >= 0) {
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, running.input, nullptr);
+            close(running.input);
+        }
+        if (running.output >= 0) {
+            // Something the command started still holds the pipe open.
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, running.output, nullptr);
+            close(running.output);
+        }
+
+        WorkerResult result;
+        result.status = status;
+        result.timedOut = running.timedOut;
+        result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - running.started).count();
+
+        auto success = !result.timedOut && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (success) {
+            completed_++;
+        }
+        else {
+            failed_++;
+        }
+
+        slc::logInfo() << "Finished " << running.job.command << " (pid " << (int32_t)running.pid << ", "
+                   << (WIFEXITED(status) ? "exit " : "signal ") << (int32_t)(WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status))
+                   << ", " << result.elapsed << "ms)";
+
+        if (running.job.done) {
+            running.job.done(running.job, result);
+        }
+
+        it = running_.erase(it);
+    }
+}
+
+int32_t WorkerPool::nextTimeout() {
+    if (running_.empty()) {
+        return -1;
+    }
+
+    // Poll for exits at least this often, commands can exit without closing
+    // the pipe if they leave something running in the background.
+    auto timeout = (int64_t)1000;
+    auto now = clock::now();
+    for (auto &pair : running_) {
+        auto &running = pair.second;
+        if (running.output < 0) {
+            timeout = std::min(timeout, (int64_t)10);
+        }
+        if (running.deadline != clock::time_point::max() && !running.timedOut) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(running.deadline - now).count();
+            timeout = std::min(timeout, std::max(remaining, (int64_t)0));
+        }
+    }
+    return (int32_t)timeout;
+}
@@ -0,0 +1,111 @@
+#ifndef SLC_WORKER_POOL_H_INCLUDED
+#define SLC_WORKER_POOL_H_INCLUDED
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+
+struct WorkerResult {
+    // Exit status as returned by waitpid, or -1 if the command never ran.
+    int32_t status{ -1 };
+    bool timedOut{ false };
+    uint32_t elapsed{ 0 };
+};
+
+struct WorkerJob {
+    std::string command;
+    std::function<void(WorkerJob&, WorkerResult&)> done;
+    // Written to the command's stdin, which is /dev/null if this is empty.
+    std::string input;
+};
+
+/**
+ * Runs shell commands as child processes, at most N at a time. Children are
+ * started with posix_spawn and a single supervisor thread multiplexes all
+ * of their output through epoll, so a slow command only ever holds up its
+ * own slot and never needs a thread of its own.
+ */
+class WorkerPool {
+public:
+    static constexpr size_t MaximumLineLength = 256;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Running {
+        WorkerJob job;
+        pid_t pid;
+        int32_t output;
+        int32_t input;
+        size_t inputWritten;
+        clock::time_point started;
+        clock::time_point deadline;
+        bool timedOut;
+        std::string line;
+    };
+
+    size_t workers_;
+    uint32_t timeout_;
+    int32_t epoll_{ -1 };
+    int32_t wakeup_{ -1 };
+    std::thread thread_;
+    std::atomic<bool> stopping_{ false };
+    std::mutex mutex_;
+    std::deque<WorkerJob> queued_;
+    std::map<pid_t, Running> running_;
+    std::atomic<size_t> depth_{ 0 };
+    std::atomic<uint32_t> completed_{ 0 };
+    std::atomic<uint32_t> failed_{ 0 };
+
+public:
+    /**
+     * timeout is per job in milliseconds, zero for none.
+     */
+    WorkerPool(size_t workers, uint32_t timeout);
+    virtual ~WorkerPool();
+
+public:
+    bool start();
+    void stop();
+    void submit(WorkerJob job);
+
+public:
+    /**
+     * Jobs waiting for a free worker.
+     */
+    size_t depth() {
+        return depth_;
+    }
+
+    uint32_t completed() {
+        return completed_;
+    }
+
+    uint32_t failed() {
+        return failed_;
+    }
+
+public:
+    void operator()();
+
+private:
+    void spawnQueued();
+    bool spawn(WorkerJob &job);
+    void drain(Running &running);
+    void feed(Running &running);
+    void reap();
+    void expire();
+    int32_t nextTimeout();
+    void wake();
+
+};
+
+#endif
@@ -0,0 +1,444 @@
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "node_protocol.h"
+#include "gateway_protocol.h"
+#include "simulated_channel.h"
+#include "simulated_radio.h"
+
+struct Options {
+    std::vector<uint32_t> nodes{ 1, 5, 10, 25, 50, 100 };
+    uint32_t size{ 4096 };
+    uint32_t files{ 1 };
+    uint32_t wake{ 20000 };
+    uint32_t duration{ 3600 };
+    uint32_t tick{ 10 };
+    uint32_t seed{ 1 };
+    uint16_t dutyCycle{ 0 };
+    uint32_t beacon{ 0 };
+    uint32_t drift{ 0 };
+    uint32_t priority{ 0 };
+    bool states{ false };
+    bool trace{ false };
+};
+
+class SimulatedNodeCallbacks : public NodeNetworkCallbacks {
+private:
+    size_t size_;
+    uint32_t files_;
+    uint32_t file_{ 0 };
+    lws::CountingReader reader_;
+
+public:
+    SimulatedNodeCallbacks(size_t size, uint32_t files) : size_(size), files_(files), reader_(size) {
+    }
+
+public:
+    size_t pendingSize() override {
+        return size_ * files_;
+    }
+
+    NodeNetworkCallbacks::OpenedReader openReader() override {
+        file_ = 0;
+        reader_ = lws::CountingReader(size_);
+        return NodeNetworkCallbacks::OpenedReader{ &reader_, size_ };
+    }
+
+    void closeReader(lws::Reader *reader) override {
+    }
+
+    bool hasNextReader() override {
+        return file_ + 1 < files_;
+    }
+
+    NodeNetworkCallbacks::OpenedReader nextReader() override {
+        file_++;
+        reader_ = lws::CountingReader(size_);
+        return NodeNetworkCallbacks::OpenedReader{ &reader_, size_ };
+    }
+
+};
+
+struct SimulatedNode {
+    DriftingClock clock;
+    SimulatedRadio radio;
+    SimulatedNodeCallbacks callbacks;
+    NodeNetworkProtocol protocol;
+    uint32_t startAt{ 0 };
+    uint32_t attemptedAt{ 0 };
+    bool attempting{ false };
+    // Files the gateway has committed this attempt.
+    uint32_t committed{ 0 };
+    // When the PRIORITY message in flight was raised, 0 if there isn't one.
+    uint32_t raisedAt{ 0 };
+    bool failed{ false };
+    uint32_t failedAt{ 0 };
+    // The protocol's next deadline, in shared time. Ticked sooner only if
+    // the radio hands it something.
+    uint32_t wakeAt{ 0 };
+
+    // The radio keeps shared time so the channel can line frames up, the
+    // protocol runs on the node's own crystal.
+    SimulatedNode(SimulatedChannel &channel, VirtualClock &shared, size_t size, uint32_t files, int32_t ppm)
+        : clock(shared, ppm), radio(channel, shared), callbacks(size, files), protocol(radio, callbacks, clock) {
+    }
+};
+
+class CountingWriter : public lws::Writer {
+private:
+    NodeLoraId nodeId_;
+    size_t written_{ 0 };
+
+public:
+    CountingWriter(NodeLoraId nodeId) : nodeId_(nodeId) {
+    }
+
+public:
+    int32_t write(uint8_t *ptr, size_t size) override {
+        written_ += size;
+        return size;
+    }
+
+    int32_t write(uint8_t byte) override {
+        written_++;
+        return 1;
+    }
+
+    void close() override {
+    }
+
+public:
+    NodeLoraId &nodeId() {
+        return nodeId_;
+    }
+
+    size_t written() {
+        return written_;
+    }
+
+};
+
+struct Completed {
+    NodeLoraId nodeId;
+    size_t bytes;
+};
+
+class SimulatedGatewayCallbacks : public GatewayNetworkCallbacks {
+private:
+    std::vector<Completed> completed_;
+    std::vector<NodeLoraId> prioritized_;
+
+public:
+    lws::Writer *openWriter(RadioPacket &packet) override {
+        return new CountingWriter(packet.getNodeId());
+    }
+
+    bool closeWriter(lws::Writer *writer, bool success) override {
+        auto counting = reinterpret_cast<CountingWriter*>(writer);
+        if (success) {
+            completed_.emplace_back(Completed{ counting->nodeId(), counting->written() });
+        }
+        delete counting;
+        return success;
+    }
+
+    void priority(RadioPacket &packet) override {
+        prioritized_.emplace_back(packet.getNodeId());
+    }
+
+public:
+    std::vector<Completed> &completed() {
+        return completed_;
+    }
+
+    std::vector<NodeLoraId> &prioritized() {
+        return prioritized_;
+    }
+
+};
+
+struct Report {
+    uint32_t nodes{ 0 };
+    uint32_t attempts{ 0 };
+    // Attempts that got every file through.
+    uint32_t sessions{ 0 };
+    uint32_t uploads{ 0 };
+    uint32_t failures{ 0 };
+    uint64_t bytes{ 0 };
+    std::vector<uint32_t> latencies;
+    ChannelStats channel;
+    // Total ms node receivers were on, across all nodes.
+    uint64_t listening{ 0 };
+    std::vector<uint32_t> alarms;
+    // Every node's time in each state, added together.
+    StateStats states;
+    // Times a node's protocol was ticked, across all nodes.
+    uint64_t wakeups{ 0 };
+};
+
+static NodeLoraId nodeIdFor(uint32_t index) {
+    NodeLoraId id;
+    id[0] = 0xcc;
+    id[4] = (index >> 24) & 0xff;
+    id[5] = (index >> 16) & 0xff;
+    id[6] = (index >> 8) & 0xff;
+    id[7] = (index) & 0xff;
+    return id;
+}
+
+static uint32_t indexFor(NodeLoraId &id) {
+    return (id[4] << 24) | (id[5] << 16) | (id[6] << 8) | id[7];
+}
+
+static uint32_t percentile(std::vector<uint32_t> &sorted, float p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto index = (size_t)(p * (sorted.size() - 1) + 0.5f);
+    return sorted[index];
+}
+
+static Report simulate(Options &options, uint32_t numberOfNodes) {
+    Report report;
+    report.nodes = numberOfNodes;
+
+    srand(options.seed);
+
+    VirtualClock clock;
+    SimulatedChannel channel;
+
+    DeviceClock gatewayClock{ clock };
+    SimulatedRadio gatewayRadio{ channel, gatewayClock };
+    SimulatedGatewayCallbacks gatewayCallbacks;
+    GatewayNetworkProtocol gateway{ gatewayRadio, gatewayCallbacks, gatewayClock };
+    gateway.dutyCycle().limit(options.dutyCycle);
+    gateway.beaconEvery(options.beacon);
+
+    std::vector<std::unique_ptr<SimulatedNode>> nodes;
+    for (auto i = 0u; i < numberOfNodes; ++i) {
+        auto ppm = options.drift > 0 ? (int32_t)(rand() % (2 * options.drift + 1)) - (int32_t)options.drift : 0;
+        auto node = std::unique_ptr<SimulatedNode>(new SimulatedNode(channel, clock, options.size, options.files, ppm));
+        node->protocol.setNodeId(nodeIdFor(i));
+        node->protocol.dutyCycle().limit(options.dutyCycle);
+        // Nodes are never powered on in lockstep, so spread the first wake.
+        node->startAt = clock.millis() + (rand() % options.wake);
+        nodes.emplace_back(std::move(node));
+    }
+
+    auto finishAt = clock.millis() + options.duration * 1000;
+
+    while (clock.millis() < finishAt) {
+        auto now = clock.millis();
+
+        channel.service(now);
+
+        if (!gatewayClock.isBusy()) {
+            gateway.tick();
+            while (gatewayRadio.hasPacket() && !gatewayClock.isBusy()) {
+                auto lora = gatewayRadio.getLoraPacket();
+                gateway.push(lora);
+            }
+        }
+
+        for (auto &completed : gatewayCallbacks.completed()) {
+            auto &node = nodes[indexFor(completed.nodeId)];
+            if (node->attempting && ++node->committed == options.files) {
+                report.latencies.push_back(now - node->attemptedAt);
+                report.sessions++;
+                node->attempting = false;
+            }
+            report.uploads++;
+            report.bytes += completed.bytes;
+        }
+        gatewayCallbacks.completed().clear();
+
+        for (auto &nodeId : gatewayCallbacks.prioritized()) {
+            auto &node = nodes[indexFor(nodeId)];
+            if (node->raisedAt > 0) {
+                report.alarms.push_back(now - node->raisedAt);
+                node->raisedAt = 0;
+            }
+        }
+        gatewayCallbacks.prioritized().clear();
+
+        for (auto &node : nodes) {
+            // Still blocked in a delay(), like the gateway above.
+            if (now < node->startAt || node->clock.isBusy()) {
+                continue;
+            }
+
+            if (now >= node->wakeAt || node->radio.hasPacket()) {
+                node->protocol.tick();
+                report.wakeups++;
+
+                while (node->radio.hasPacket()) {
+                    auto lora = node->radio.getLoraPacket();
+                    node->protocol.push(lora);
+                }
+
+                auto deadline = node->protocol.nextDeadline();
+                node->wakeAt = deadline == NetworkProtocol::Forever ? UINT32_MAX : now + deadline;
+            }
+
+            if (options.priority > 0 && !node->protocol.hasPriority()) {
+                // Given up on, if it's still outstanding.
+                node->raisedAt = 0;
+                if (rand() % (options.priority / options.tick + 1) == 0) {
+                    uint8_t alarm[16] = { 0 };
+                    node->protocol.sendPriority(alarm, sizeof(alarm));
+                    node->raisedAt = now;
+                    node->wakeAt = now;
+                }
+            }
+
+            if (node->protocol.hasErrorOccured()) {
+                if (!node->failed) {
+                    node->failed = true;
+                    node->failedAt = now;
+                    node->attempting = false;
+                    report.failures++;
+                    if (options.trace) {
+                        slc::logInfo() << "Node " << (uint32_t)(&node - &nodes[0]) << " failed";
+                        node->protocol.trace().dump();
+                        node->protocol.stateStats().dump();
+                    }
+                }
+                if (now - node->failedAt < options.wake) {
+                    continue;
+                }
+            }
+            else if (!node->protocol.hasBeenSleepingFor(options.wake)) {
+                continue;
+            }
+
+            node->failed = false;
+            node->attempting = true;
+            node->attemptedAt = now;
+            node->committed = 0;
+            node->protocol.sendToGateway();
+            node->wakeAt = now;
+            report.attempts++;
+        }
+
+        clock.advance(options.tick);
+    }
+
+    report.channel = channel.stats();
+
+    for (auto &node : nodes) {
+        report.listening += node->radio.listening();
+        report.states.merge(node->protocol.stateStats());
+    }
+
+    std::sort(report.latencies.begin(), report.latencies.end());
+    std::sort(report.alarms.begin(), report.alarms.end());
+
+    return report;
+}
+
+static std::vector<uint32_t> parseList(std::string value) {
+    std::vector<uint32_t> values;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        values.push_back((uint32_t)std::stoul(item));
+    }
+    return values;
+}
+
+int32_t main(int32_t argc, const char **argv) {
+    Options options;
+
+    for (auto i = 0; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--states") {
+            options.states = true;
+            continue;
+        }
+        if (arg == "--trace") {
+            options.trace = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            break;
+        }
+        if (arg == "--nodes") {
+            options.nodes = parseList(argv[++i]);
+        }
+        else if (arg == "--size") {
+            options.size = std::stoul(argv[++i]);
+        }
+        else if (arg == "--files") {
+            options.files = std::stoul(argv[++i]);
+        }
+        else if (arg == "--wake") {
+            options.wake = std::stoul(argv[++i]);
+        }
+        else if (arg == "--duration") {
+            options.duration = std::stoul(argv[++i]);
+        }
+        else if (arg == "--tick") {
+            options.tick = std::stoul(argv[++i]);
+        }
+        else if (arg == "--seed") {
+            options.seed = std::stoul(argv[++i]);
+        }
+        else if (arg == "--duty-cycle") {
+            options.dutyCycle = std::stoul(argv[++i]);
+        }
+        else if (arg == "--beacon") {
+            options.beacon = std::stoul(argv[++i]);
+        }
+        else if (arg == "--drift") {
+            options.drift = std::stoul(argv[++i]);
+        }
+        else if (arg == "--priority") {
+            options.priority = std::stoul(argv[++i]);
+        }
+    }
+
+    std::vector<Report> reports;
+    for (auto n : options.nodes) {
+        reports.emplace_back(simulate(options, n));
+    }
+
+    fprintf(stdout, "\n# size=%u files=%u wake=%ums duration=%us tick=%ums seed=%u beacon=%ums drift=%uppm priority=%ums\n",
+            options.size, options.files, options.wake, options.duration, options.tick, options.seed, options.beacon, options.drift, options.priority);
+    fprintf(stdout, "%8s %9s %8s %9s %9s %10s %10s %12s %9s %11s %9s %8s %15s %10s\n",
+            "nodes", "attempts", "uploads", "success%", "failures", "p50(ms)", "p99(ms)", "goodput(B/s)", "airtime%", "collisions", "node-rx%", "alarms", "alarm-p99(ms)", "wakeups/s");
+    for (auto &r : reports) {
+        auto success = r.attempts > 0 ? 100.0f * r.sessions / r.attempts : 0.0f;
+        auto goodput = (float)r.bytes / options.duration;
+        auto airtime = 100.0f * r.channel.airtime / (options.duration * 1000.0f);
+        auto listening = 100.0f * r.listening / (r.nodes * options.duration * 1000.0f);
+        auto wakeups = (float)r.wakeups / (r.nodes * options.duration);
+        fprintf(stdout, "%8u %9u %8u %9.1f %9u %10u %10u %12.1f %9.2f %11u %9.2f %8u %15u %10.2f\n",
+                r.nodes, r.attempts, r.uploads, success, r.failures,
+                percentile(r.latencies, 0.50f), percentile(r.latencies, 0.99f),
+                goodput, airtime, r.channel.collisions, listening,
+                (uint32_t)r.alarms.size(), percentile(r.alarms, 0.99f), wakeups);
+    }
+
+    if (options.states) {
+        for (auto &r : reports) {
+            fprintf(stdout, "\n# nodes=%u time in each state, across all nodes\n", r.nodes);
+            fprintf(stdout, "%20s %9s %8s %10s %10s %10s\n", "state", "entered", "time%", "min(ms)", "avg(ms)", "max(ms)");
+            auto total = r.states.total();
+            for (auto i = 0u; i < NumberOfNetworkStates; ++i) {
+                auto &s = r.states[(NetworkState)i];
+                if (s.count == 0) {
+                    continue;
+                }
+                fprintf(stdout, "%20s %9u %8.2f %10u %10u %10u\n", getStateName((NetworkState)i), s.count,
+                        total > 0 ? 100.0f * s.total / total : 0.0f, s.minimum, s.average(), s.maximum);
+            }
+        }
+    }
+
+    return 0;
+}
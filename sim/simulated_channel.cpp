@@ -0,0 +1,61 @@
+#include <algorithm>
+
+#include "simulated_channel.h"
+#include "simulated_radio.h"
+
+void SimulatedChannel::attach(SimulatedRadio &radio) {
+    radios_.push_back(&radio);
+}
+
+void SimulatedChannel::transmit(SimulatedRadio &sender, LoraPacket &packet, uint32_t now) {
+    auto tx = Transmission{ &sender, now, now + sender.timeOnAir(packet), false, packet };
+
+    for (auto &other : inflight_) {
+        if (other.startedAt < tx.endsAt && tx.startedAt < other.endsAt) {
+            if (!other.collided) {
+                other.collided = true;
+                stats_.collisions++;
+            }
+            if (!tx.collided) {
+                tx.collided = true;
+                stats_.collisions++;
+            }
+        }
+    }
+
+    stats_.transmissions++;
+    stats_.airtime += tx.endsAt - tx.startedAt;
+
+    inflight_.emplace_back(tx);
+}
+
+void SimulatedChannel::service(uint32_t now) {
+    for (auto &tx : inflight_) {
+        if (tx.endsAt > now) {
+            continue;
+        }
+        tx.sender->transmitted();
+        if (tx.collided) {
+            continue;
+        }
+        for (auto radio : radios_) {
+            if (radio != tx.sender && radio->canReceive(tx.startedAt)) {
+                radio->received(tx.packet);
+                stats_.deliveries++;
+            }
+        }
+    }
+
+    inflight_.erase(std::remove_if(inflight_.begin(), inflight_.end(), [&](Transmission &tx) {
+        return tx.endsAt <= now;
+    }), inflight_.end());
+}
+
+bool SimulatedChannel::hearing(SimulatedRadio &radio, uint32_t from, uint32_t to) {
+    for (auto &tx : inflight_) {
+        if (tx.sender != &radio && tx.startedAt >= from && tx.startedAt <= to) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,55 @@
+#ifndef SLC_SIMULATED_CHANNEL_H_INCLUDED
+#define SLC_SIMULATED_CHANNEL_H_INCLUDED
+
+#include <vector>
+
+#include "packets.h"
+
+class SimulatedRadio;
+
+struct ChannelStats {
+    uint32_t transmissions{ 0 };
+    uint32_t collisions{ 0 };
+    uint32_t deliveries{ 0 };
+    uint64_t airtime{ 0 };
+};
+
+/**
+ * A single shared LoRa channel. Every frame occupies the channel for the
+ * sender's time on air, frames that overlap in time are all lost, and a
+ * radio only hears a frame if it was listening for the whole of it. No
+ * capture effect and no path loss, so the numbers are a best case for
+ * contention.
+ */
+class SimulatedChannel {
+private:
+    struct Transmission {
+        SimulatedRadio *sender;
+        uint32_t startedAt;
+        uint32_t endsAt;
+        bool collided;
+        LoraPacket packet;
+    };
+
+    std::vector<SimulatedRadio*> radios_;
+    std::vector<Transmission> inflight_;
+    ChannelStats stats_;
+
+public:
+    void attach(SimulatedRadio &radio);
+    void transmit(SimulatedRadio &sender, LoraPacket &packet, uint32_t now);
+    void service(uint32_t now);
+
+    /**
+     * True if someone else has a frame in the air that began in [from, to].
+     */
+    bool hearing(SimulatedRadio &radio, uint32_t from, uint32_t to);
+
+public:
+    ChannelStats &stats() {
+        return stats_;
+    }
+
+};
+
+#endif
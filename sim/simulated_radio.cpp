@@ -0,0 +1,69 @@
+#include "simulated_radio.h"
+#include "simulated_channel.h"
+
+SimulatedRadio::SimulatedRadio(SimulatedChannel &channel, Clock &clock) : channel_(&channel), clock_(&clock) {
+    channel.attach(*this);
+}
+
+void SimulatedRadio::change(Mode mode) {
+    auto now = clock_->millis();
+    if (isModeRx()) {
+        listening_ += now - rxSince_;
+    }
+    mode_ = mode;
+    rxSince_ = now;
+}
+
+void SimulatedRadio::setModeRx() {
+    if (mode_ != Mode::Rx) {
+        change(Mode::Rx);
+    }
+}
+
+void SimulatedRadio::setModeRxSingle(uint32_t timeout) {
+    change(Mode::RxSingle);
+    rxUntil_ = rxSince_ + timeout;
+}
+
+bool SimulatedRadio::hasRxTimedOut() {
+    if (mode_ != Mode::RxSingle || clock_->millis() <= rxUntil_) {
+        return false;
+    }
+    // Anything that started in the window is still being received.
+    if (channel_->hearing(*this, rxSince_, rxUntil_)) {
+        return false;
+    }
+    change(Mode::Idle);
+    return true;
+}
+
+uint64_t SimulatedRadio::listening() {
+    if (isModeRx()) {
+        return listening_ + clock_->millis() - rxSince_;
+    }
+    return listening_;
+}
+
+bool SimulatedRadio::sendPacket(LoraPacket &packet) {
+    change(Mode::Tx);
+    channel_->transmit(*this, packet, clock_->millis());
+    return true;
+}
+
+LoraPacket SimulatedRadio::getLoraPacket() {
+    auto packet = incoming_.front();
+    incoming_.pop();
+    return packet;
+}
+
+void SimulatedRadio::received(LoraPacket &packet) {
+    // Both real drivers drop back to standby after RxDone.
+    incoming_.emplace(packet);
+    change(Mode::Idle);
+}
+
+void SimulatedRadio::transmitted() {
+    if (mode_ == Mode::Tx) {
+        change(Mode::Idle);
+    }
+}
@@ -0,0 +1,167 @@
+#ifndef SLC_SIMULATED_RADIO_H_INCLUDED
+#define SLC_SIMULATED_RADIO_H_INCLUDED
+
+#include <queue>
+
+#include "packet_radio.h"
+#include "clock.h"
+
+class SimulatedChannel;
+
+/**
+ * Clock for one simulated device. Reads the shared virtual time, but a
+ * delay() only makes this device busy rather than moving everybody forward.
+ * This mirrors the gateway blocking in delay(ReplyDelay) while the nodes
+ * around it keep running.
+ */
+class DeviceClock : public Clock {
+private:
+    VirtualClock *shared_;
+    uint32_t busyUntil_{ 0 };
+
+public:
+    DeviceClock(VirtualClock &shared) : shared_(&shared) {
+    }
+
+public:
+    uint32_t millis() override {
+        auto now = shared_->millis();
+        return busyUntil_ > now ? busyUntil_ : now;
+    }
+
+    void delay(uint32_t ms) override {
+        busyUntil_ = millis() + ms;
+    }
+
+    bool isBusy() {
+        return busyUntil_ > shared_->millis();
+    }
+
+};
+
+/**
+ * Clock for a simulated node whose crystal runs ppm parts per million fast
+ * (or slow, if negative) compared to the shared virtual time. Like
+ * DeviceClock, a delay() only makes this node busy.
+ */
+class DriftingClock : public Clock {
+private:
+    VirtualClock *shared_;
+    int32_t ppm_;
+    // In shared time.
+    uint32_t busyUntil_{ 0 };
+
+public:
+    DriftingClock(VirtualClock &shared, int32_t ppm) : shared_(&shared), ppm_(ppm) {
+    }
+
+public:
+    uint32_t millis() override {
+        auto now = shared();
+        return now + (int32_t)((int64_t)now * ppm_ / 1000000);
+    }
+
+    void delay(uint32_t ms) override {
+        // ms on our crystal, which is that much longer or shorter for
+        // everybody else.
+        busyUntil_ = shared() + (uint32_t)((int64_t)ms * 1000000 / (1000000 + ppm_));
+    }
+
+    bool isBusy() {
+        return busyUntil_ > shared_->millis();
+    }
+
+private:
+    uint32_t shared() {
+        auto now = shared_->millis();
+        return busyUntil_ > now ? busyUntil_ : now;
+    }
+
+};
+
+class SimulatedRadio : public PacketRadio {
+private:
+    enum class Mode {
+        Sleep,
+        Idle,
+        Rx,
+        RxSingle,
+        Tx,
+    };
+
+    SimulatedChannel *channel_;
+    Clock *clock_;
+    Mode mode_{ Mode::Sleep };
+    uint32_t rxSince_{ 0 };
+    // Last moment a preamble can start in an RX-single window.
+    uint32_t rxUntil_{ 0 };
+    uint64_t listening_{ 0 };
+    uint8_t address_{ 0xff };
+    std::queue<LoraPacket> incoming_;
+
+public:
+    SimulatedRadio(SimulatedChannel &channel, Clock &clock);
+
+public:
+    bool isModeRx() override {
+        return mode_ == Mode::Rx || mode_ == Mode::RxSingle;
+    }
+
+    bool isModeTx() override {
+        return mode_ == Mode::Tx;
+    }
+
+    bool isIdle() override {
+        return mode_ == Mode::Idle;
+    }
+
+    void setModeRx() override;
+    void setModeRxSingle(uint32_t timeout) override;
+    bool hasRxTimedOut() override;
+
+    void setModeIdle() override {
+        change(Mode::Idle);
+    }
+
+    void sleep() override {
+        change(Mode::Sleep);
+    }
+
+    bool sendPacket(LoraPacket &packet) override;
+
+    void setThisAddress(uint8_t address) override {
+        address_ = address;
+    }
+
+public:
+    bool hasPacket() {
+        return !incoming_.empty();
+    }
+
+    LoraPacket getLoraPacket();
+
+    /**
+     * True if this radio has been listening, uninterrupted, since the given
+     * time and so would have caught a frame whose preamble began then.
+     */
+    bool canReceive(uint32_t startedAt) {
+        if (mode_ == Mode::RxSingle) {
+            return rxSince_ <= startedAt && startedAt <= rxUntil_;
+        }
+        return mode_ == Mode::Rx && rxSince_ <= startedAt;
+    }
+
+    void received(LoraPacket &packet);
+    void transmitted();
+
+    /**
+     * Total ms spent with the receiver on.
+     */
+    uint64_t listening();
+
+private:
+    void change(Mode mode);
+
+};
+
+#endif
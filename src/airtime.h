@@ -0,0 +1,186 @@
+#ifndef SLC_AIRTIME_H_INCLUDED
+#define SLC_AIRTIME_H_INCLUDED
+
+#include <cstdint>
+
+/**
+ * Raw values for the three SX127x modem configuration registers, exactly as
+ * they are written to the radio.
+ */
+struct modem_config_t {
+    uint8_t reg_1d;
+    uint8_t reg_1e;
+    uint8_t reg_26;
+};
+
+// Bw500Cr45Sf128, which is what both drivers end up configured with.
+constexpr modem_config_t LoraDefaultModemConfig = { 0x92, 0x74, 0x00 };
+
+constexpr uint16_t LoraDefaultPreambleLength = 8;
+
+constexpr uint32_t loraBandwidth(modem_config_t config) {
+    switch (config.reg_1d >> 4) {
+    case 0: return 7800;
+    case 1: return 10400;
+    case 2: return 15600;
+    case 3: return 20800;
+    case 4: return 31250;
+    case 5: return 41700;
+    case 6: return 62500;
+    case 7: return 125000;
+    case 8: return 250000;
+    default: return 500000;
+    }
+}
+
+constexpr uint8_t loraSpreadingFactor(modem_config_t config) {
+    return config.reg_1e >> 4;
+}
+
+// 1 through 4 for 4/5 through 4/8.
+constexpr uint8_t loraCodingRate(modem_config_t config) {
+    return (config.reg_1d >> 1) & 0x07;
+}
+
+constexpr bool loraImplicitHeader(modem_config_t config) {
+    return (config.reg_1d & 0x01) == 0x01;
+}
+
+constexpr bool loraCrc(modem_config_t config) {
+    return (config.reg_1e & 0x04) == 0x04;
+}
+
+constexpr bool loraLowDataRateOptimize(modem_config_t config) {
+    return (config.reg_26 & 0x08) == 0x08;
+}
+
+/**
+ * Length of one symbol in microseconds.
+ */
+constexpr uint32_t loraSymbolTime(modem_config_t config) {
+    return (uint32_t)(((uint64_t)1 << loraSpreadingFactor(config)) * 1000000 / loraBandwidth(config));
+}
+
+/**
+ * Number of payload symbols for a frame of the given size, including the
+ * eight symbols of fixed overhead. See the SX1276 datasheet, section 4.1.1.7.
+ */
+constexpr uint32_t loraPayloadSymbols(modem_config_t config, uint32_t bytes) {
+    int32_t sf = loraSpreadingFactor(config);
+    int32_t numerator = 8 * (int32_t)bytes - 4 * sf + 28 + (loraCrc(config) ? 16 : 0) - (loraImplicitHeader(config) ? 20 : 0);
+    int32_t denominator = 4 * (sf - (loraLowDataRateOptimize(config) ? 2 : 0));
+    int32_t blocks = numerator > 0 ? (numerator + denominator - 1) / denominator : 0;
+    return 8 + blocks * (loraCodingRate(config) + 4);
+}
+
+/**
+ * Length of the preamble and sync word in microseconds, which is what a
+ * receiver has to catch to hear a frame at all.
+ */
+constexpr uint32_t loraPreambleTime(modem_config_t config, uint16_t preamble = LoraDefaultPreambleLength) {
+    return (uint32_t)(((uint64_t)(4 * preamble + 17) * loraSymbolTime(config)) / 4);
+}
+
+/**
+ * Time on air in microseconds for a frame whose PHY payload is the given
+ * number of bytes, so the four byte RadioHead header must be included.
+ */
+constexpr uint32_t loraTimeOnAir(modem_config_t config, uint32_t bytes, uint16_t preamble = LoraDefaultPreambleLength) {
+    return (uint32_t)(loraPreambleTime(config, preamble) + (uint64_t)loraPayloadSymbols(config, bytes) * loraSymbolTime(config));
+}
+
+/**
+ * Value for the 10 bit RX-single symbol timeout (REG_1F and the bottom of
+ * REG_1E) that keeps the radio looking for a preamble for about the given
+ * number of ms. Never less than a preamble, so slow configurations can still
+ * catch one.
+ */
+constexpr uint16_t loraSymbolTimeout(modem_config_t config, uint32_t ms, uint16_t preamble = LoraDefaultPreambleLength) {
+    return (uint16_t)(((uint64_t)ms * 1000 / loraSymbolTime(config)) < preamble ? preamble :
+                      ((uint64_t)ms * 1000 / loraSymbolTime(config)) > 0x3ff ? 0x3ff :
+                      ((uint64_t)ms * 1000 / loraSymbolTime(config)));
+}
+
+static_assert(loraSymbolTime(LoraDefaultModemConfig) == 256, "SF7/500kHz symbols are 256us");
+static_assert(loraPreambleTime(LoraDefaultModemConfig) == 3136, "SF7/500kHz preamble");
+static_assert(loraTimeOnAir(LoraDefaultModemConfig, 255) == 99904, "SF7/500kHz full frame");
+static_assert(loraSymbolTimeout(LoraDefaultModemConfig, 100) == 390, "SF7/500kHz 100ms window");
+
+/**
+ * Rolling window accounting of our own transmit time. The window is kept as
+ * a ring of buckets, so memory is fixed and the window slides one bucket at
+ * a time. A budget of zero disables enforcement, which is the case for US915.
+ */
+class DutyCycle {
+public:
+    static constexpr uint32_t Window = 60 * 60 * 1000;
+    static constexpr uint8_t NumberOfBuckets = 60;
+    static constexpr uint32_t BucketLength = Window / NumberOfBuckets;
+
+private:
+    uint32_t buckets_[NumberOfBuckets] = { 0 };
+    // Any value of millis() is a valid start, 0 included.
+    bool started_{ false };
+    uint32_t bucketStart_{ 0 };
+    uint8_t head_{ 0 };
+    uint32_t used_{ 0 };
+    uint32_t budget_{ 0 };
+
+public:
+    /**
+     * Limit transmit time to the given fraction of the window, in tenths of
+     * a percent, so 10 is the 1% common in EU868 sub-bands.
+     */
+    void limit(uint16_t permille) {
+        budget_ = (uint32_t)(((uint64_t)Window * permille) / 1000);
+    }
+
+    bool enabled() {
+        return budget_ > 0;
+    }
+
+    uint32_t used() {
+        return used_;
+    }
+
+    uint32_t budget() {
+        return budget_;
+    }
+
+    bool canTransmit(uint32_t now, uint32_t ms) {
+        if (!enabled()) {
+            return true;
+        }
+        slide(now);
+        return used_ + ms <= budget_;
+    }
+
+    void record(uint32_t now, uint32_t ms) {
+        slide(now);
+        buckets_[head_] += ms;
+        used_ += ms;
+    }
+
+private:
+    void slide(uint32_t now) {
+        if (!started_) {
+            started_ = true;
+            bucketStart_ = now;
+            return;
+        }
+        auto steps = 0;
+        while (now - bucketStart_ >= BucketLength && steps < NumberOfBuckets) {
+            head_ = (head_ + 1) % NumberOfBuckets;
+            used_ -= buckets_[head_];
+            buckets_[head_] = 0;
+            bucketStart_ += BucketLength;
+            steps++;
+        }
+        if (now - bucketStart_ >= BucketLength) {
+            bucketStart_ = now;
+        }
+    }
+
+};
+
+#endif
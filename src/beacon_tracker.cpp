@@ -0,0 +1,64 @@
+#include "beacon_tracker.h"
+
+bool BeaconTracker::heard(uint32_t at, uint32_t time, uint32_t epoch, uint32_t period) {
+    auto restarted = synchronized() && (epoch < epoch_ || (int32_t)(time - time_) < 0);
+    if (!synchronized() || restarted) {
+        anchorAt_ = at;
+        anchorTime_ = time;
+    }
+    else {
+        auto baseline = time - anchorTime_;
+        if (baseline >= MinimumBaseline) {
+            auto local = at - anchorAt_;
+            auto sample = (int32_t)(((int64_t)local - (int64_t)baseline) * 1000000 / baseline);
+            drift_ = measured_ ? (3 * drift_ + sample) / 4 : sample;
+            measured_ = true;
+            anchorAt_ = at;
+            anchorTime_ = time;
+        }
+    }
+    heardAt_ = at;
+    time_ = time;
+    epoch_ = epoch;
+    period_ = period;
+    misses_ = 0;
+    return !restarted;
+}
+
+bool BeaconTracker::missed() {
+    if (++misses_ > MaximumMisses) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+void BeaconTracker::clear() {
+    // What we know about our crystal is still good.
+    heardAt_ = 0;
+    period_ = 0;
+    misses_ = 0;
+}
+
+uint32_t BeaconTracker::next(uint32_t now) {
+    auto beacons = (now - heardAt_) / localPeriod() + 1;
+    auto at = predict(beacons);
+    if ((int32_t)(at - guard(at) - now) <= 0) {
+        at = predict(beacons + 1);
+    }
+    return at;
+}
+
+uint32_t BeaconTracker::guard(uint32_t at) {
+    auto ppm = measured_ ? MeasuredDriftPpm : UnmeasuredDriftPpm;
+    return MinimumGuard + (uint32_t)((uint64_t)(at - heardAt_) * ppm / 1000000);
+}
+
+uint32_t BeaconTracker::predict(uint32_t beacons) {
+    // Drift is applied over the whole span so it doesn't round per period.
+    return heardAt_ + beacons * period_ + (int32_t)((int64_t)beacons * period_ * drift_ / 1000000);
+}
+
+uint32_t BeaconTracker::localPeriod() {
+    return period_ + (int32_t)((int64_t)period_ * drift_ / 1000000);
+}
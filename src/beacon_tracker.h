@@ -0,0 +1,82 @@
+#ifndef SLC_BEACON_TRACKER_H_INCLUDED
+#define SLC_BEACON_TRACKER_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * A node's idea of when the gateway will next beacon, in its own clock.
+ * Times are when the beacon's preamble started. Crystal drift is measured
+ * over long baselines because we only ever see beacons to within a loop
+ * tick, and the guard we listen with grows with time since we last heard
+ * one so a slow or fast clock can't walk us out of the window.
+ */
+class BeaconTracker {
+public:
+    // Loop and interrupt latency on either side.
+    static constexpr uint32_t MinimumGuard = 20;
+    // Assumed until we've measured our crystal against the gateway's.
+    static constexpr uint32_t UnmeasuredDriftPpm = 100;
+    // Left over after measuring, mostly temperature.
+    static constexpr uint32_t MeasuredDriftPpm = 10;
+    // Shortest gateway time between beacons we'll measure drift over.
+    static constexpr uint32_t MinimumBaseline = 60000;
+    static constexpr uint8_t MaximumMisses = 3;
+
+private:
+    uint32_t heardAt_{ 0 };
+    uint32_t time_{ 0 };
+    uint32_t epoch_{ 0 };
+    uint32_t period_{ 0 };
+    // Where drift is being measured from, local and gateway time.
+    uint32_t anchorAt_{ 0 };
+    uint32_t anchorTime_{ 0 };
+    // How much faster our clock runs than the gateway's.
+    int32_t drift_{ 0 };
+    bool measured_{ false };
+    uint8_t misses_{ 0 };
+
+public:
+    /**
+     * Returns false if the gateway restarted, in which case we've started
+     * over and anything assigned to us under the old epoch is stale.
+     */
+    bool heard(uint32_t at, uint32_t time, uint32_t epoch, uint32_t period);
+
+    /**
+     * Returns false once we've missed so many we've lost sync.
+     */
+    bool missed();
+
+    void clear();
+
+    /**
+     * Local time of the first beacon we can still open a window for.
+     */
+    uint32_t next(uint32_t now);
+
+    /**
+     * How far either side of a beacon predicted for at we need to listen.
+     */
+    uint32_t guard(uint32_t at);
+
+public:
+    bool synchronized() {
+        return period_ > 0;
+    }
+
+    int32_t drift() {
+        return drift_;
+    }
+
+    uint32_t epoch() {
+        return epoch_;
+    }
+
+private:
+    uint32_t localPeriod();
+    uint32_t predict(uint32_t beacons);
+
+};
+
+#endif
@@ -0,0 +1,7 @@
+#include "clock.h"
+
+namespace slc {
+
+SystemClock systemClock;
+
+}
@@ -0,0 +1,82 @@
+#ifndef SLC_CLOCK_H_INCLUDED
+#define SLC_CLOCK_H_INCLUDED
+
+#include <cstdint>
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#elif defined(SLC_HOST)
+#include "host.h"
+#else
+#include <wiringPi.h>
+#endif
+
+/**
+ * Source of time for the protocol classes. Everything that used to call
+ * millis() and delay() directly goes through one of these so that runs can
+ * be driven by something other than the wall clock.
+ */
+class Clock {
+public:
+    virtual uint32_t millis() = 0;
+    virtual void delay(uint32_t ms) = 0;
+
+};
+
+class SystemClock : public Clock {
+public:
+    uint32_t millis() override {
+        return ::millis();
+    }
+
+    void delay(uint32_t ms) override {
+        ::delay(ms);
+    }
+
+};
+
+/**
+ * Discrete-event clock. Time only moves when the owner advances it, and a
+ * delay() simply jumps ahead instead of blocking, so a simulation can skip
+ * directly from one deadline to the next.
+ */
+class VirtualClock : public Clock {
+private:
+    // Starts at one because a zero time is used to mean "not started".
+    uint32_t now_{ 1 };
+
+public:
+    VirtualClock() {
+    }
+
+    VirtualClock(uint32_t now) : now_(now) {
+    }
+
+public:
+    uint32_t millis() override {
+        return now_;
+    }
+
+    void delay(uint32_t ms) override {
+        now_ += ms;
+    }
+
+    void advance(uint32_t ms) {
+        now_ += ms;
+    }
+
+    void advanceTo(uint32_t time) {
+        if (time > now_) {
+            now_ = time;
+        }
+    }
+
+};
+
+namespace slc {
+
+extern SystemClock systemClock;
+
+}
+
+#endif
@@ -21,11 +21,13 @@ typedef enum _fk_radio_PacketKind {
     fk_radio_PacketKind_PING = 2,
     fk_radio_PacketKind_PONG = 3,
     fk_radio_PacketKind_PREPARE = 4,
-    fk_radio_PacketKind_DATA = 5
+    fk_radio_PacketKind_DATA = 5,
+    fk_radio_PacketKind_BEACON = 6,
+    fk_radio_PacketKind_PRIORITY = 7
 } fk_radio_PacketKind;
 #define _fk_radio_PacketKind_MIN fk_radio_PacketKind_ACK
-#define _fk_radio_PacketKind_MAX fk_radio_PacketKind_DATA
-#define _fk_radio_PacketKind_ARRAYSIZE ((fk_radio_PacketKind)(fk_radio_PacketKind_DATA+1))
+#define _fk_radio_PacketKind_MAX fk_radio_PacketKind_PRIORITY
+#define _fk_radio_PacketKind_ARRAYSIZE ((fk_radio_PacketKind)(fk_radio_PacketKind_PRIORITY+1))
 
 /* Struct definitions */
 typedef struct _fk_radio_RadioPacket {
@@ -34,13 +36,23 @@ typedef struct _fk_radio_RadioPacket {
     int32_t address;
     int32_t size;
     pb_callback_t data;
+    uint32_t offset;
+    uint32_t backoff;
+    uint32_t slot;
+    uint32_t window;
+    uint32_t time;
+    uint32_t epoch;
+    uint32_t period;
+    uint32_t phase;
+    bool more;
+    uint32_t message;
 /* @@protoc_insertion_point(struct:fk_radio_RadioPacket) */
 } fk_radio_RadioPacket;
 
 
 /* Initializer values for message structs */
-#define fk_radio_RadioPacket_init_default        {_fk_radio_PacketKind_MIN, {{NULL}, NULL}, 0, 0, {{NULL}, NULL}}
-#define fk_radio_RadioPacket_init_zero           {_fk_radio_PacketKind_MIN, {{NULL}, NULL}, 0, 0, {{NULL}, NULL}}
+#define fk_radio_RadioPacket_init_default        {_fk_radio_PacketKind_MIN, {{NULL}, NULL}, 0, 0, {{NULL}, NULL}, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+#define fk_radio_RadioPacket_init_zero           {_fk_radio_PacketKind_MIN, {{NULL}, NULL}, 0, 0, {{NULL}, NULL}, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
 
 /* Field tags (for use in manual encoding/decoding) */
 #define fk_radio_RadioPacket_kind_tag            1
@@ -48,6 +60,16 @@ typedef struct _fk_radio_RadioPacket {
 #define fk_radio_RadioPacket_address_tag         3
 #define fk_radio_RadioPacket_size_tag            4
 #define fk_radio_RadioPacket_data_tag            5
+#define fk_radio_RadioPacket_offset_tag          6
+#define fk_radio_RadioPacket_backoff_tag         7
+#define fk_radio_RadioPacket_slot_tag            8
+#define fk_radio_RadioPacket_window_tag          9
+#define fk_radio_RadioPacket_time_tag            10
+#define fk_radio_RadioPacket_epoch_tag           11
+#define fk_radio_RadioPacket_period_tag          12
+#define fk_radio_RadioPacket_phase_tag           13
+#define fk_radio_RadioPacket_more_tag            14
+#define fk_radio_RadioPacket_message_tag         15
 
 /* Struct field encoding specification for nanopb */
 #define fk_radio_RadioPacket_FIELDLIST(X, a) \
@@ -55,7 +77,17 @@ X(a, STATIC, SINGULAR, UENUM, kind, 1) \
 X(a, CALLBACK, SINGULAR, BYTES, nodeId, 2) \
 X(a, STATIC, SINGULAR, INT32, address, 3) \
 X(a, STATIC, SINGULAR, INT32, size, 4) \
-X(a, CALLBACK, SINGULAR, BYTES, data, 5)
+X(a, CALLBACK, SINGULAR, BYTES, data, 5) \
+X(a, STATIC, SINGULAR, UINT32, offset, 6) \
+X(a, STATIC, SINGULAR, UINT32, backoff, 7) \
+X(a, STATIC, SINGULAR, UINT32, slot, 8) \
+X(a, STATIC, SINGULAR, UINT32, window, 9) \
+X(a, STATIC, SINGULAR, UINT32, time, 10) \
+X(a, STATIC, SINGULAR, UINT32, epoch, 11) \
+X(a, STATIC, SINGULAR, UINT32, period, 12) \
+X(a, STATIC, SINGULAR, UINT32, phase, 13) \
+X(a, STATIC, SINGULAR, BOOL, more, 14) \
+X(a, STATIC, SINGULAR, UINT32, message, 15)
 #define fk_radio_RadioPacket_CALLBACK pb_default_field_callback
 #define fk_radio_RadioPacket_DEFAULT NULL
 
@@ -9,72 +9,206 @@ inline LogStream& operator<<(LogStream &log, const PacketLogMessage &plm) {
     return log << plm.packet.m().kind << " " << plm.packet.getNodeId() << " " << plm.lora.id << " p(" << plm.lora.size << " bytes)";
 }
 
-bool CurrentNodeTracker::canPongPing(RadioPacket &packet) {
+bool CurrentNodeTracker::isBusy(RadioPacket &packet) {
     if (id_ == packet.getNodeId()) {
-        return true;
-    }
-
-    if (millis() - lastPing_ < 1000) {
         return false;
     }
+    return active_ && clock_->millis() - lastActivity_ < SessionTimeout;
+}
 
-    lastPing_ = millis();
+void CurrentNodeTracker::assign(RadioPacket &packet) {
+    lastActivity_ = clock_->millis();
+    active_ = true;
     id_ = packet.getNodeId();
+}
 
-    return true;
+void CurrentNodeTracker::touch(RadioPacket &packet) {
+    if (id_ == packet.getNodeId()) {
+        lastActivity_ = clock_->millis();
+    }
+}
+
+void CurrentNodeTracker::release(RadioPacket &packet) {
+    if (id_ == packet.getNodeId()) {
+        active_ = false;
+    }
 }
 
-DownloadTracker::DownloadTracker(GatewayNetworkCallbacks &callbacks) : callbacks_(&callbacks) {
+uint32_t CurrentNodeTracker::appointment(uint32_t busyFor) {
+    auto now = clock_->millis();
+    auto at = now + busyFor;
+    if ((int32_t)(nextAppointment_ - at) > 0) {
+        at = nextAppointment_;
+    }
+    nextAppointment_ = at + AppointmentSpacing;
+    return at - now;
+}
+
+DownloadTracker::DownloadTracker(GatewayNetworkCallbacks &callbacks, Clock &clock, TraceRing *trace) : callbacks_(&callbacks), clock_(&clock), trace_(trace) {
 }
 
-bool DownloadTracker::prepare(LogStream &log, LoraPacket &lora, RadioPacket &packet) {
+bool DownloadTracker::prepare(slc::FrameLogStream &log, LoraPacket &lora, RadioPacket &packet) {
+    auto size = packet.m().size;
+    if (size < 0 || size > MaximumUploadSize) {
+        log << " size(" << size << " bytes) REFUSED";
+        return false;
+    }
     if (writer_ != nullptr) {
         writer_->close();
         callbacks_->closeWriter(writer_, false);
     }
     writer_ = callbacks_->openWriter(packet);
+    from_ = packet.getNodeId();
+    prepared_ = true;
+    failed_ = writer_ == nullptr;
     received_ = 0;
-    expected_ = packet.m().size;
-    receiveSequence_ = 0;
+    expected_ = size;
     return true;
 }
 
-bool DownloadTracker::download(LogStream &log, LoraPacket &lora, RadioPacket &packet) {
-    auto dupe = (lora.id != (uint8_t)(receiveSequence_ + 1));
+bool DownloadTracker::download(slc::FrameLogStream &log, LoraPacket &lora, RadioPacket &packet) {
     auto data = packet.data();
+    auto offset = (size_t)packet.m().offset;
     auto closed = data.size == 0;
-    if (!dupe) {
+    auto gap = offset > received_;
+    auto skip = gap ? 0 : received_ - offset;
+    auto dupe = !gap && !closed && skip >= data.size;
+    auto overlap = !gap && !dupe && skip > 0 && !closed;
+    if (!gap && !dupe && !failed_) {
         if (writer_ != nullptr) {
-            if (data.size > 0) {
-                auto written = writer_->write(data.ptr, data.size);
-                assert(written == (int32_t)data.size);
+            if (!closed) {
+                auto written = writer_->write(data.ptr + skip, data.size - skip);
+                if (written != (int32_t)(data.size - skip)) {
+                    writer_->close();
+                    callbacks_->closeWriter(writer_, false);
+                    writer_ = nullptr;
+                    failed_ = true;
+                }
             }
             else {
-                callbacks_->closeWriter(writer_, true);
+                failed_ = !callbacks_->closeWriter(writer_, true);
                 writer_ = nullptr;
             }
         }
-        received_ += data.size;
-        receiveSequence_ = lora.id;
+        if (!failed_) {
+            received_ += data.size - skip;
+        }
     }
     auto mismatch = closed && (received_ != expected_);
-    log << " data(" << data.size << " bytes) total(" << received_ << "/" << expected_ << " bytes)"
-        << (dupe ? " DUPE" : "") << (closed ? " CLOSED" : "") << (mismatch ? " MISMATCH" : "");
-    return true;
+    auto flags = (dupe ? TraceDataDupe : 0) | (overlap ? TraceDataOverlap : 0) | (gap ? TraceDataGap : 0) | (closed ? TraceDataClosed : 0) | (failed_ ? TraceDataFailed : 0);
+    if (trace_ != nullptr) {
+        trace_->record(clock_->millis(), TraceEvent::Data, flags, offset);
+    }
+    log << " data(" << data.size << " bytes @ " << offset << ") total(" << received_ << "/" << expected_ << " bytes)"
+        << (dupe ? " DUPE" : "") << (overlap ? " OVERLAP" : "") << (gap ? " GAP" : "")
+        << (closed ? " CLOSED" : "") << (closed && packet.m().more ? " MORE" : "") << (mismatch ? " MISMATCH" : "")
+        << (failed_ ? " FAILED" : "");
+    return !gap && !failed_;
+}
+
+uint32_t GatewayNetworkProtocol::roundTrip() {
+    return getRadio()->timeOnAir(MaximumFrameSize) + ReplyDelay + getRadio()->timeOnAir(0);
+}
+
+uint32_t GatewayNetworkProtocol::busyFor() {
+    auto frames = (download.remaining() + MaximumDataSize - 1) / MaximumDataSize + 1;
+    return frames * roundTrip();
+}
+
+uint32_t GatewayNetworkProtocol::estimate(uint32_t size) {
+    if (size == 0) {
+        size = DefaultUploadSize;
+    }
+    auto frames = (size + MaximumDataSize - 1) / MaximumDataSize + 2;
+    return frames * roundTrip();
+}
+
+void GatewayNetworkProtocol::turnAway(slc::FrameLogStream &le, RadioPacket &packet) {
+    schedule.cancel(packet.getNodeId());
+    auto backoff = currentNode.appointment(busyFor());
+    le << " BUSY(" << backoff << "ms)";
+    le.flush();
+    getClock()->delay(ReplyDelay);
+    auto busy = RadioPacket{ fk_radio_PacketKind_NACK, packet.getNodeId() };
+    busy.m().backoff = backoff;
+    sendPacket(std::move(busy));
+}
+
+void GatewayNetworkProtocol::refuse(slc::FrameLogStream &le, RadioPacket &packet) {
+    le.flush();
+    getClock()->delay(ReplyDelay);
+    sendPacket(RadioPacket{ fk_radio_PacketKind_NACK, packet.getNodeId() });
+}
+
+bool GatewayNetworkProtocol::heardPriority(RadioPacket &packet) {
+    PriorityHeard *heard = nullptr;
+    for (auto &p : priorities) {
+        if (p.heardAt > 0 && p.nodeId == packet.getNodeId()) {
+            heard = &p;
+            break;
+        }
+    }
+
+    auto again = heard != nullptr && heard->message == packet.m().message &&
+        now() - heard->heardAt < 2 * receiveWindow();
+
+    if (heard == nullptr) {
+        heard = &priorities[nextPriority];
+        nextPriority = (nextPriority + 1) % MaximumPriorityNodes;
+        heard->nodeId = packet.getNodeId();
+    }
+    heard->message = packet.m().message;
+    heard->heardAt = now();
+
+    return again;
+}
+
+void GatewayNetworkProtocol::beaconEvery(uint32_t period) {
+    beaconPeriod = (period > 0 && period < MinimumBeaconPeriod) ? MinimumBeaconPeriod : period;
+    beaconedAt = 0;
+}
+
+void GatewayNetworkProtocol::sendBeacon() {
+    // Skipped beacons still count, nodes will just miss this one.
+    beaconedAt = now();
+    auto beacon = RadioPacket{ fk_radio_PacketKind_BEACON };
+    beacon.m().time = beaconedAt;
+    beacon.m().epoch = ++epoch;
+    beacon.m().period = beaconPeriod;
+    sendPacket(std::move(beacon));
+}
+
+uint32_t GatewayNetworkProtocol::phaseOf(uint32_t at) {
+    auto phase = (at - beaconedAt) % beaconPeriod;
+    if (phase < SlotSchedule::Guard || phase + SlotSchedule::Guard > beaconPeriod) {
+        return SlotSchedule::Guard;
+    }
+    return phase;
 }
 
 void GatewayNetworkProtocol::tick() {
+    if (wasDeferred()) {
+        sendDeferred();
+    }
+
     switch (getState()) {
     case NetworkState::Starting: {
         transition(NetworkState::Listening);
         break;
     }
     case NetworkState::Idle: {
-        getRadio()->setModeIdle();
+        if (entering()) {
+            getRadio()->setModeIdle();
+        }
         break;
     }
     case NetworkState::Listening: {
-        getRadio()->setModeRx();
+        if (beaconPeriod > 0 && (beaconedAt == 0 || now() - beaconedAt >= beaconPeriod)) {
+            sendBeacon();
+        }
+        if (!getRadio()->isModeTx() && !getRadio()->isModeRx()) {
+            getRadio()->setModeRx();
+        }
         break;
     }
     case NetworkState::SendPong: {
@@ -86,14 +220,54 @@ void GatewayNetworkProtocol::tick() {
     }
 }
 
+uint32_t GatewayNetworkProtocol::nextDeadline() {
+    auto deadline = stateDeadline();
+    if (wasDeferred() && deadline > DeferredPollInterval) {
+        return DeferredPollInterval;
+    }
+    return deadline;
+}
+
+uint32_t GatewayNetworkProtocol::stateDeadline() {
+    switch (getState()) {
+    case NetworkState::Starting: {
+        return 0;
+    }
+    case NetworkState::Listening: {
+        if (getRadio()->isModeTx()) {
+            return PollInterval;
+        }
+        if (!getRadio()->isModeRx()) {
+            return 0;
+        }
+        if (beaconPeriod == 0) {
+            return Forever;
+        }
+        if (beaconedAt == 0) {
+            return 0;
+        }
+        auto dueIn = (int32_t)(beaconedAt + beaconPeriod - now());
+        return dueIn > 0 ? (uint32_t)dueIn : 0;
+    }
+    case NetworkState::Idle: {
+        return hasEntered() ? Forever : 0;
+    }
+    default: {
+        return PollInterval;
+    }
+    }
+}
+
 void GatewayNetworkProtocol::push(LoraPacket &lora) {
     auto packet = RadioPacket{ };
     if (!packet.decode(lora)) {
-        slc::log() << "Malformed packet.";
+        slc::logErrors() << "Malformed packet.";
         return;
     }
 
-    auto le = slc::log();
+    trace().record(now(), TraceEvent::Received, packet.m().kind, lora.size);
+
+    auto le = slc::logFrames();
 
     le << "R " << PacketLogMessage{ lora, packet };
 
@@ -101,28 +275,92 @@ void GatewayNetworkProtocol::push(LoraPacket &lora) {
     case NetworkState::Listening: {
         switch (packet.m().kind) {
         case fk_radio_PacketKind_PING: {
-            if (!currentNode.canPongPing(packet)) {
-                le << " IGNORE";
-                le.flush();
+            auto busy = currentNode.isBusy(packet);
+            auto earliest = now() + (busy ? busyFor() : 0);
+            auto slot = schedule.book(packet.getNodeId(), now(), earliest, estimate(packet.m().size));
+            if (slot != nullptr && busy && (int32_t)(slot->startsAt - now()) <= 0) {
+                // A slot that's come around while someone else is still going.
+                schedule.cancel(packet.getNodeId());
+                slot = schedule.book(packet.getNodeId(), now(), earliest, estimate(packet.m().size));
+            }
+            if (slot == nullptr) {
+                turnAway(le, packet);
                 break;
             }
+            auto offset = (int32_t)(slot->startsAt - now()) > 0 ? slot->startsAt - now() : 0;
+            if (offset == 0) {
+                currentNode.assign(packet);
+            }
+            le << " SLOT(" << offset << "ms, " << slot->duration << "ms)";
             le.flush();
-            delay(ReplyDelay);
+            getClock()->delay(ReplyDelay);
             auto pong = RadioPacket{ fk_radio_PacketKind_PONG, packet.getNodeId() };
             pong.m().address = currentNode.address();
+            pong.m().slot = offset;
+            pong.m().window = slot->duration;
+            if (beaconPeriod > 0) {
+                pong.m().phase = phaseOf(slot->startsAt);
+            }
             sendPacket(std::move(pong));
             break;
         }
         case fk_radio_PacketKind_PREPARE: {
+            if (currentNode.isBusy(packet)) {
+                turnAway(le, packet);
+                break;
+            }
+            if (!download.prepare(le, lora, packet)) {
+                refuse(le, packet);
+                break;
+            }
+            currentNode.assign(packet);
             le.flush();
-            download.prepare(le, lora, packet);
-            delay(ReplyDelay);
+            getClock()->delay(ReplyDelay);
             sendAck(lora.from);
             break;
         }
+        case fk_radio_PacketKind_PRIORITY: {
+            // Answered even while another node is uploading. Nodes slip these
+            // in between their own DATA frames, or send them outside a session.
+            auto again = heardPriority(packet);
+            le << " message(" << packet.m().message << ", " << packet.data().size << " bytes)" << (again ? " DUPE" : "");
+            le.flush();
+            getClock()->delay(ReplyDelay);
+            // Every node shares an address, so say whose message this was.
+            auto ack = RadioPacket{ fk_radio_PacketKind_ACK, packet.getNodeId() };
+            ack.m().message = packet.m().message;
+            sendPacket(std::move(ack));
+            // Only once the ACK's away, the node is waiting on it.
+            if (!again) {
+                callbacks->priority(packet);
+            }
+            break;
+        }
         case fk_radio_PacketKind_DATA: {
-            download.download(le, lora, packet);
-            delay(ReplyDelay);
+            // DATA from a node whose session timed out would otherwise be
+            // written into whoever has the gateway now.
+            if (currentNode.isBusy(packet) || !download.isFrom(packet)) {
+                le << " STRAY";
+                refuse(le, packet);
+                break;
+            }
+            currentNode.touch(packet);
+            schedule.active(packet.getNodeId(), now());
+            if (!download.download(le, lora, packet)) {
+                if (download.failed()) {
+                    // Don't let the node think it's stored, it'd delete it.
+                    currentNode.release(packet);
+                    schedule.release(packet.getNodeId(), now());
+                    refuse(le, packet);
+                }
+                break;
+            }
+            // The session stays open while the node has more files for us.
+            if (packet.data().size == 0 && !packet.m().more) {
+                currentNode.release(packet);
+                schedule.release(packet.getNodeId(), now());
+            }
+            getClock()->delay(ReplyDelay);
             sendAck(lora.from);
             break;
         }
@@ -5,60 +5,239 @@
 
 #include "protocol.h"
 #include "device_id.h"
+#include "slot_schedule.h"
 
 class GatewayNetworkCallbacks {
 public:
     virtual lws::Writer *openWriter(RadioPacket &packet) = 0;
-    virtual void closeWriter(lws::Writer *writer, bool success) = 0;
+
+    /**
+     * Returns true only if success was asked for and the upload is now
+     * stored, which is what the node's final ACK promises.
+     */
+    virtual bool closeWriter(lws::Writer *writer, bool success) = 0;
+
+    /**
+     * A PRIORITY message, handed over as soon as it arrives. The payload is
+     * packet.data() and is only valid for the call.
+     */
+    virtual void priority(RadioPacket &packet) {
+    }
 
 };
 
+/**
+ * Which node the gateway is talking to. Other nodes are turned away until
+ * it's been quiet for SessionTimeout or its upload closes, and are given
+ * appointments spaced AppointmentSpacing apart so they don't all come back
+ * at once.
+ */
 class CurrentNodeTracker {
+public:
+    static constexpr uint32_t SessionTimeout = 3000;
+    static constexpr uint32_t AppointmentSpacing = 1000;
+
 private:
-    uint32_t lastPing_{ 0 };
+    Clock *clock_;
+    uint32_t lastActivity_{ 0 };
+    uint32_t nextAppointment_{ 0 };
     uint8_t address_{ 1 };
+    bool active_{ false };
     NodeLoraId id_;
 
+public:
+    CurrentNodeTracker(Clock &clock) : clock_(&clock) {
+    }
+
 public:
     uint8_t address() {
         return address_;
     }
 
 public:
-    bool canPongPing(RadioPacket &radio);
+    /**
+     * True if some other node has the gateway's attention.
+     */
+    bool isBusy(RadioPacket &packet);
+
+    /**
+     * Makes this the node we're talking to.
+     */
+    void assign(RadioPacket &packet);
+
+    /**
+     * Notes traffic from the current node, keeping its session open.
+     */
+    void touch(RadioPacket &packet);
+
+    /**
+     * Ends the current node's session, if this is from them.
+     */
+    void release(RadioPacket &packet);
+
+    /**
+     * Books the next appointment at least busyFor ms from now and returns
+     * how long the node should wait.
+     */
+    uint32_t appointment(uint32_t busyFor);
 
 };
 
+/**
+ * Places DATA by the byte offset each frame carries. Frames overlapping what
+ * we already have are trimmed (or dropped entirely as duplicates) and frames
+ * past the end of what we have are refused, as the writer is sequential.
+ */
 class DownloadTracker {
+public:
+    // Bigger than anything a node keeps. PREPARE sizes past this are
+    // refused rather than handed to the storage backend to reserve.
+    static constexpr int32_t MaximumUploadSize = 16 * 1024 * 1024;
+
 private:
     GatewayNetworkCallbacks *callbacks_{ nullptr };
+    Clock *clock_;
+    TraceRing *trace_;
+    // Contiguous bytes received, and so the next offset we can accept.
     size_t received_{ 0 };
     size_t expected_{ 0 };
-    uint8_t receiveSequence_{ 0 };
     lws::Writer *writer_{ nullptr };
+    // The writer refused something, so nothing more is ACK'd.
+    bool failed_{ false };
+    // Who the last upload is from, kept after it closes so a retried close
+    // can still be ACK'd.
+    NodeLoraId from_;
+    bool prepared_{ false };
 
 public:
-    DownloadTracker(GatewayNetworkCallbacks &callbacks);
+    DownloadTracker(GatewayNetworkCallbacks &callbacks, Clock &clock = slc::systemClock, TraceRing *trace = nullptr);
 
 public:
-    bool prepare(LogStream &log, LoraPacket &lora, RadioPacket &radio);
-    bool download(LogStream &log, LoraPacket &lora, RadioPacket &packet);
+    /**
+     * Opens a writer for a new upload. Returns false, leaving any upload in
+     * progress alone, if the size the node gave is negative or too big.
+     */
+    bool prepare(slc::FrameLogStream &log, LoraPacket &lora, RadioPacket &radio);
+
+    /**
+     * True if packet is from the node that sent the last PREPARE.
+     */
+    bool isFrom(RadioPacket &packet) {
+        return prepared_ && from_ == packet.getNodeId();
+    }
+
+    /**
+     * Returns false if the frame can't be placed and shouldn't be ACK'd.
+     */
+    bool download(slc::FrameLogStream &log, LoraPacket &lora, RadioPacket &packet);
+
+    /**
+     * True once the upload couldn't be stored, the node should be told
+     * rather than ACK'd.
+     */
+    bool failed() {
+        return failed_;
+    }
+
+    /**
+     * Bytes still expected from the upload in progress.
+     */
+    size_t remaining() {
+        return writer_ != nullptr && expected_ > received_ ? expected_ - received_ : 0;
+    }
 
 };
 
 class GatewayNetworkProtocol : public NetworkProtocol {
 private:
+    // Assumed for nodes that don't say how much they have.
+    static constexpr uint32_t DefaultUploadSize = 16 * MaximumDataSize;
+    // Leaves room for a few phases either side of the beacon's guard.
+    static constexpr uint32_t MinimumBeaconPeriod = 4 * SlotSchedule::Guard;
+    // Nodes whose last PRIORITY message we remember, oldest replaced first.
+    static constexpr size_t MaximumPriorityNodes = 16;
+
+    struct PriorityHeard {
+        NodeLoraId nodeId;
+        uint32_t message{ 0 };
+        uint32_t heardAt{ 0 };
+    };
+
+    GatewayNetworkCallbacks *callbacks;
     CurrentNodeTracker currentNode;
     DownloadTracker download;
+    SlotSchedule schedule;
+    // Each node's last PRIORITY message delivered, so a retry isn't
+    // delivered again. Forgotten once its retries would have stopped,
+    // message numbers start over when a node reboots.
+    PriorityHeard priorities[MaximumPriorityNodes];
+    size_t nextPriority{ 0 };
+    // 0 while beacons are off.
+    uint32_t beaconPeriod{ 0 };
+    uint32_t beaconedAt{ 0 };
+    // Beacons sent since we started, so nodes can tell when we restart.
+    uint32_t epoch{ 0 };
 
 public:
-    GatewayNetworkProtocol(PacketRadio &radio, GatewayNetworkCallbacks &callbacks) : NetworkProtocol(radio), download(callbacks) {
+    GatewayNetworkProtocol(PacketRadio &radio, GatewayNetworkCallbacks &callbacks, Clock &clock = slc::systemClock)
+        : NetworkProtocol(radio, clock), callbacks(&callbacks), currentNode(clock), download(callbacks, clock, &trace()) {
     }
 
 public:
     void tick();
+
+    /**
+     * How long until tick() has anything to do, see NodeNetworkProtocol.
+     * Sooner while a reply is waiting on the duty cycle.
+     */
+    uint32_t nextDeadline();
+
     void push(LoraPacket &lora);
 
+    /**
+     * Beacon our time every period ms. Nodes that hear them wake for the
+     * next one and PING at the phase after it we gave them in their last
+     * PONG, instead of contending at random. 0 turns beacons off.
+     */
+    void beaconEvery(uint32_t period);
+
+private:
+    void sendBeacon();
+
+    uint32_t stateDeadline();
+
+    /**
+     * Where a slot starting at falls after the last beacon, kept clear of
+     * the beacons either side.
+     */
+    uint32_t phaseOf(uint32_t at);
+
+    /**
+     * Rough time until the current upload finishes, one stop-and-wait round
+     * trip per remaining frame.
+     */
+    uint32_t busyFor();
+
+    /**
+     * Rough time to upload size bytes, including PREPARE and the close.
+     */
+    uint32_t estimate(uint32_t size);
+
+    uint32_t roundTrip();
+
+    void turnAway(slc::FrameLogStream &log, RadioPacket &packet);
+
+    /**
+     * NACKs without an appointment, the node gives up on this upload.
+     */
+    void refuse(slc::FrameLogStream &log, RadioPacket &packet);
+
+    /**
+     * Remembers the node's PRIORITY message, true if it's a retry of one
+     * we've already delivered.
+     */
+    bool heardPriority(RadioPacket &packet);
+
 };
 
 #endif
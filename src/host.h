@@ -0,0 +1,23 @@
+#ifndef SLC_HOST_H_INCLUDED
+#define SLC_HOST_H_INCLUDED
+#if defined(SLC_HOST)
+
+#include <cstdint>
+#include <chrono>
+#include <thread>
+
+// Stand-ins for the few Arduino/wiringPi calls the protocol needs, so the
+// protocol can be built and exercised on a plain Linux machine.
+
+inline uint32_t millis() {
+    static auto started = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+inline void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#endif
+#endif
@@ -0,0 +1,106 @@
+#ifndef SLC_LOGGING_H_INCLUDED
+#define SLC_LOGGING_H_INCLUDED
+
+#include <alogging/alogging.h>
+
+#define SLC_LOG_NONE    0
+#define SLC_LOG_ERRORS  1
+#define SLC_LOG_INFO    2
+#define SLC_LOG_FRAMES  3
+
+/**
+ * Statements above this level compile away entirely, arguments and all. The
+ * MCU skips per frame logging by default, it's printf over serial in the
+ * middle of every ACK turnaround.
+ */
+#ifndef SLC_LOG_LEVEL
+#if defined(ARDUINO)
+#define SLC_LOG_LEVEL SLC_LOG_INFO
+#else
+#define SLC_LOG_LEVEL SLC_LOG_FRAMES
+#endif
+#endif
+
+namespace slc {
+
+extern Logger log;
+
+enum class LogLevel {
+    Errors = SLC_LOG_ERRORS,
+    Info = SLC_LOG_INFO,
+    // Something for every frame sent or received.
+    Frames = SLC_LOG_FRAMES,
+};
+
+/**
+ * Stands in for a LogStream at disabled levels. Everything written to it is
+ * discarded at compile time, including any custom operator<< formatting.
+ */
+class NullLogStream {
+public:
+    template<typename T>
+    NullLogStream &operator<<(const T &) {
+        return *this;
+    }
+
+    NullLogStream &print(const char *) {
+        return *this;
+    }
+
+    NullLogStream &printf(const char *, ...) {
+        return *this;
+    }
+
+    void flush() {
+    }
+
+};
+
+template<LogLevel Level, bool Enabled = ((int)Level <= SLC_LOG_LEVEL)>
+struct LogAt {
+    using Stream = LogStream;
+
+    static LogStream open() {
+        return log();
+    }
+};
+
+template<LogLevel Level>
+struct LogAt<Level, false> {
+    using Stream = NullLogStream;
+
+    static NullLogStream open() {
+        return NullLogStream{ };
+    }
+};
+
+template<LogLevel Level>
+inline typename LogAt<Level>::Stream logAt() {
+    return LogAt<Level>::open();
+}
+
+using ErrorLogStream = LogAt<LogLevel::Errors>::Stream;
+using InfoLogStream = LogAt<LogLevel::Info>::Stream;
+using FrameLogStream = LogAt<LogLevel::Frames>::Stream;
+
+/**
+ * Failures, and the trace and state dumps the main loops ask for after one.
+ */
+inline ErrorLogStream logErrors() {
+    return logAt<LogLevel::Errors>();
+}
+
+/**
+ * Progress, configuration and anything else worth a line now and then.
+ */
+inline InfoLogStream logInfo() {
+    return logAt<LogLevel::Info>();
+}
+
+inline FrameLogStream logFrames() {
+    return logAt<LogLevel::Frames>();
+}
+
+}
+
+#endif
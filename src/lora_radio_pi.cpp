@@ -14,27 +14,34 @@ static void handle_isr() {
     }
 }
 
-LoraRadioPi::LoraRadioPi(uint8_t pinCs, uint8_t pinReset, uint8_t pinDio0, uint8_t spiChannel) : pinCs(pinCs), pinReset(pinReset), pinDio0(pinDio0), spiChannel(spiChannel) {
+LoraRadioPi::LoraRadioPi(SpiBackend &spi, uint8_t pinCs, uint8_t pinReset, uint8_t pinDio0, uint8_t spiChannel) : spi(&spi), pinCs(pinCs), pinReset(pinReset), pinDio0(pinDio0), spiChannel(spiChannel) {
 }
 
 LoraRadioPi::~LoraRadioPi() {
+    pthread_cond_destroy(&event);
     pthread_mutex_destroy(&mutex);
 }
 
 bool LoraRadioPi::setup() {
     pthread_mutex_init(&mutex, NULL);
+    // The Pi has no RTC, so the wall clock can jump when NTP syncs.
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&event, &attributes);
+    pthread_condattr_destroy(&attributes);
 
     return true;
 }
 
 bool LoraRadioPi::begin() {
-    pinMode(pinCs, OUTPUT);
-    pinMode(pinDio0, INPUT);
-    pinMode(pinReset, OUTPUT);
+    spi->pinMode(pinCs, true);
+    spi->pinMode(pinDio0, false);
+    spi->pinMode(pinReset, true);
 
     radios_for_isr[0] = this;
 
-    wiringPiISR(pinDio0, INT_EDGE_RISING, handle_isr);
+    spi->attachInterrupt(pinDio0, handle_isr);
 
     reset();
 
@@ -43,14 +50,14 @@ bool LoraRadioPi::begin() {
     }
 
     spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_SLEEP | RH_RF95_LONG_RANGE_MODE);
-    delay(10);
+    spi->delay(10);
 
     spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, spiRead(RH_RF95_REG_0F_FIFO_RX_BASE_ADDR));
     spiWrite(RH_RF95_REG_23_MAX_PAYLOAD_LENGTH, 0xF2);
     spiWrite(RH_RF95_REG_0E_FIFO_TX_BASE_ADDR, 0);
     spiWrite(RH_RF95_REG_0F_FIFO_RX_BASE_ADDR, 0);
 
-    setModeIdle();
+    enterIdle();
 
     setModemConfig(&Bw125Cr45Sf128);
     setModemConfig(&Bw500Cr45Sf128);
@@ -82,11 +89,78 @@ void LoraRadioPi::unlock() {
     pthread_mutex_unlock(&mutex);
 }
 
+void LoraRadioPi::signal() {
+    signalled = true;
+    pthread_cond_broadcast(&event);
+}
+
+bool LoraRadioPi::waitForEvent(uint32_t ms) {
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    lock();
+    while (!signalled) {
+        if (pthread_cond_timedwait(&event, &mutex, &deadline) != 0) {
+            break;
+        }
+    }
+    auto woken = signalled;
+    signalled = false;
+    unlock();
+    return woken;
+}
+
 uint8_t LoraRadioPi::getMode() {
-    return spiRead(RH_RF95_REG_01_OP_MODE);
+    lock();
+    auto value = spiRead(RH_RF95_REG_01_OP_MODE);
+    unlock();
+    return value;
 }
 
 void LoraRadioPi::setModeRx() {
+    lock();
+    enterRx();
+    unlock();
+}
+
+void LoraRadioPi::setModeRxSingle(uint32_t timeout) {
+    lock();
+    enterRxSingle(timeout);
+    unlock();
+}
+
+bool LoraRadioPi::hasRxTimedOut() {
+    lock();
+    auto timedOut = checkRxTimedOut();
+    unlock();
+    return timedOut;
+}
+
+void LoraRadioPi::setModeIdle() {
+    lock();
+    enterIdle();
+    unlock();
+}
+
+void LoraRadioPi::setModeTx() {
+    lock();
+    enterTx();
+    unlock();
+}
+
+void LoraRadioPi::sleep() {
+    lock();
+    enterSleep();
+    unlock();
+}
+
+void LoraRadioPi::enterRx() {
     if (mode != RH_RF95_MODE_RXCONTINUOUS) {
         spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x00); // IRQ on RxDone
         spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_RXCONTINUOUS);
@@ -94,14 +168,39 @@ void LoraRadioPi::setModeRx() {
     }
 }
 
-void LoraRadioPi::setModeIdle() {
+void LoraRadioPi::enterRxSingle(uint32_t timeout) {
+    auto symbols = loraSymbolTimeout(modemConfig_, timeout, preambleLength_);
+    enterIdle();
+    spiWrite(RH_RF95_REG_1E_MODEM_CONFIG2, (modemConfig_.reg_1e & 0xfc) | ((symbols >> 8) & 0x03));
+    spiWrite(RH_RF95_REG_1F_SYMB_TIMEOUT_LSB, symbols & 0xff);
+    spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x00); // IRQ on RxDone, RxTimeout is on DIO1
+    spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_RXSINGLE);
+    mode = RH_RF95_MODE_RXSINGLE;
+}
+
+bool LoraRadioPi::checkRxTimedOut() {
+    if (mode != RH_RF95_MODE_RXSINGLE) {
+        return false;
+    }
+    // Only DIO0 is wired up, so we poll for the timeout.
+    auto flags = spiRead(RH_RF95_REG_12_IRQ_FLAGS);
+    if ((flags & RH_RF95_RX_TIMEOUT) != RH_RF95_RX_TIMEOUT) {
+        return false;
+    }
+    spiWrite(RH_RF95_REG_12_IRQ_FLAGS, RH_RF95_RX_TIMEOUT);
+    // The radio is already in standby.
+    mode = RH_RF95_MODE_STDBY;
+    return true;
+}
+
+void LoraRadioPi::enterIdle() {
     if (mode != RH_RF95_MODE_STDBY) {
         spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_STDBY);
         mode = RH_RF95_MODE_STDBY;
     }
 }
 
-void LoraRadioPi::setModeTx() {
+void LoraRadioPi::enterTx() {
     if (mode != RH_RF95_MODE_TX) {
         spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x40); // IRQ on TxDone
         spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_TX);
@@ -109,7 +208,7 @@ void LoraRadioPi::setModeTx() {
     }
 }
 
-void LoraRadioPi::sleep() {
+void LoraRadioPi::enterSleep() {
     if (mode != RH_RF95_MODE_SLEEP) {
         spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_SLEEP);
         mode = RH_RF95_MODE_SLEEP;
@@ -121,7 +220,7 @@ bool LoraRadioPi::isModeStandby() {
 }
 
 bool LoraRadioPi::isModeRx() {
-    return mode == RH_RF95_MODE_RXCONTINUOUS;
+    return mode == RH_RF95_MODE_RXCONTINUOUS || mode == RH_RF95_MODE_RXSINGLE;
 }
 
 bool LoraRadioPi::isAvailable() {
@@ -133,7 +232,9 @@ void LoraRadioPi::setThisAddress(uint8_t address) {
 }
 
 bool LoraRadioPi::sendPacket(LoraPacket &packet) {
-    setModeIdle();
+    lock();
+
+    enterIdle();
 
     spiWrite(RH_RF95_REG_0E_FIFO_TX_BASE_ADDR, 0);
     spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, 0);
@@ -147,13 +248,33 @@ bool LoraRadioPi::sendPacket(LoraPacket &packet) {
         spiWrite(RH_RF95_REG_00_FIFO, packet.data[i]);
     }
 
-    spiWrite(RH_RF95_REG_22_PAYLOAD_LENGTH, packet.size + SX1272_HEADER_LENGTH);
+    spiWrite(RH_RF95_REG_22_PAYLOAD_LENGTH, packet.size + LoraPacket::SX1272_HEADER_LENGTH);
+
+    enterTx();
 
-    setModeTx();
+    unlock();
 
     return true;
 }
 
+bool LoraRadioPi::popIncoming(LoraPacket &lora) {
+    lock();
+    auto popped = !incoming.empty();
+    if (popped) {
+        lora = incoming.front();
+        incoming.pop();
+    }
+    unlock();
+    return popped;
+}
+
+size_t LoraRadioPi::incomingDepth() {
+    lock();
+    auto depth = incoming.size();
+    unlock();
+    return depth;
+}
+
 void LoraRadioPi::service() {
     pthread_mutex_lock(&mutex);
 
@@ -164,10 +285,12 @@ void LoraRadioPi::service() {
     }
     else if ((flags & RH_RF95_RX_DONE) == RH_RF95_RX_DONE) {
         receive();
-        setModeIdle();
+        enterIdle();
+        signal();
     }
     else if ((flags & RH_RF95_TX_DONE) == RH_RF95_TX_DONE) {
-        setModeIdle();
+        enterIdle();
+        signal();
     }
 
     spiWrite(RH_RF95_REG_12_IRQ_FLAGS, 0xff); // clear all IRQ flags
@@ -191,7 +314,7 @@ void LoraRadioPi::tick() {
 
     if (!available) {
         if (begin()) {
-            setModeRx();
+            enterRx();
             available = true;
         }
     }
@@ -202,7 +325,7 @@ void LoraRadioPi::tick() {
         }
 
         if (isModeStandby()) {
-            setModeRx();
+            enterRx();
         }
     }
 
@@ -232,9 +355,9 @@ uint8_t LoraRadioPi::spiRead(int8_t address) {
     buffer[0] = address & 0x7F;
     buffer[1] = 0x00;
 
-    digitalWrite(pinCs, LOW);
-    wiringPiSPIDataRW(spiChannel, buffer, 2);
-    digitalWrite(pinCs, HIGH);
+    spi->digitalWrite(pinCs, false);
+    spi->transfer(spiChannel, buffer, 2);
+    spi->digitalWrite(pinCs, true);
 
     return buffer[1];
 }
@@ -245,9 +368,9 @@ void LoraRadioPi::spiWrite(int8_t address, uint8_t value) {
     buffer[0] = address | 0x80;
     buffer[1] = value;
 
-    digitalWrite(pinCs, LOW);
-    wiringPiSPIDataRW(spiChannel, buffer, 2);
-    digitalWrite(pinCs, HIGH);
+    spi->digitalWrite(pinCs, false);
+    spi->transfer(spiChannel, buffer, 2);
+    spi->digitalWrite(pinCs, true);
 }
 
 void LoraRadioPi::setFrequency(float centre) {
@@ -261,6 +384,7 @@ void LoraRadioPi::setModemConfig(modem_config_t *config) {
     spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1, config->reg_1d);
     spiWrite(RH_RF95_REG_1E_MODEM_CONFIG2, config->reg_1e);
     spiWrite(RH_RF95_REG_26_MODEM_CONFIG3, config->reg_26);
+    modemConfig_ = *config;
 }
 
 void LoraRadioPi::setTxPower(int8_t power) {
@@ -274,6 +398,7 @@ void LoraRadioPi::setTxPower(int8_t power) {
 void LoraRadioPi::setPreambleLength(uint16_t length) {
     spiWrite(RH_RF95_REG_20_PREAMBLE_MSB, length >> 8);
     spiWrite(RH_RF95_REG_21_PREAMBLE_LSB, length & 0xff);
+    preambleLength_ = length;
 }
 
 int32_t LoraRadioPi::getSnr() {
@@ -296,10 +421,10 @@ int32_t LoraRadioPi::getRssi() {
 }
 
 void LoraRadioPi::reset() {
-    digitalWrite(pinReset, LOW);
-    delay(100);
-    digitalWrite(pinReset, HIGH);
-    delay(100);
+    spi->digitalWrite(pinReset, false);
+    spi->delay(100);
+    spi->digitalWrite(pinReset, true);
+    spi->delay(100);
 }
 
 #endif
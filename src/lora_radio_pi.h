@@ -3,21 +3,19 @@
 #ifndef ARDUINO
 
 #include <pthread.h>
+#include <atomic>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <vector>
 #include <queue>
 
-#include <wiringPi.h>
-#include <wiringPiSPI.h>
-
 #include "protocol.h"
+#include "spi_backend.h"
 
 #define RH_RF95_RSSI_CORRECTION                            157
 
-#define SX1272_HEADER_LENGTH                               4
-
 #define RH_RF95_REG_00_FIFO                                0x00
 #define RH_RF95_REG_01_OP_MODE                             0x01
 #define RH_RF95_REG_02_RESERVED                            0x02
@@ -137,17 +135,15 @@
 // The Frequency Synthesizer step = RH_RF95_FXOSC / 2^^19
 #define RH_RF95_FSTEP  (RH_RF95_FXOSC / 524288)
 
-struct modem_config_t {
-    uint8_t reg_1d;
-    uint8_t reg_1e;
-    uint8_t reg_26;
-};
-
 class LoraRadioPi : public PacketRadio {
 private:
+    SpiBackend *spi;
     pthread_mutex_t mutex;
+    pthread_cond_t event;
+    bool signalled{ false };
     uint8_t number;
-    uint8_t mode;
+    // Also read, without the lock, by isModeRx() and friends.
+    std::atomic<uint8_t> mode{ RH_RF95_MODE_SLEEP };
     uint8_t pinCs;
     uint8_t pinReset;
     uint8_t pinDio0;
@@ -156,11 +152,13 @@ private:
     bool available{ false };
     uint32_t checkedAt{ 0 };
     uint32_t checkRadioEvery{ 1000 };
+    modem_config_t modemConfig_ = LoraDefaultModemConfig;
+    uint16_t preambleLength_{ LoraDefaultPreambleLength };
     std::queue<LoraPacket> incoming;
     std::queue<LoraPacket> outgoing;
 
 public:
-    LoraRadioPi(uint8_t pinCs, uint8_t pinReset, uint8_t pinDio0, uint8_t spiChannel);
+    LoraRadioPi(SpiBackend &spi, uint8_t pinCs, uint8_t pinReset, uint8_t pinDio0, uint8_t spiChannel);
     virtual ~LoraRadioPi();
 
 public:
@@ -171,7 +169,9 @@ public:
     uint8_t getMode();
     void setModeTx();
     void setModeRx() override;
+    void setModeRxSingle(uint32_t timeout) override;
     void setModeIdle() override;
+    bool hasRxTimedOut() override;
 
     bool isModeRx() override;
 
@@ -188,18 +188,48 @@ public:
     bool isAvailable();
 
     void setThisAddress(uint8_t address) override;
+
+    modem_config_t modemConfig() override {
+        return modemConfig_;
+    }
+
+    uint16_t preambleLength() override {
+        return preambleLength_;
+    }
+
     bool sendPacket(LoraPacket &packet) override;
     void service();
 
     void tick();
 
-    std::queue<LoraPacket>& getIncoming() {
-        return incoming;
-    }
+    /**
+     * Takes the oldest received packet. Packets are queued from the interrupt
+     * thread, so this is safe to call from any other.
+     */
+    bool popIncoming(LoraPacket &lora);
+
+    size_t incomingDepth();
+
+    /**
+     * Blocks for up to ms, returning early once a packet has arrived or a
+     * transmission has finished. True if one did.
+     */
+    bool waitForEvent(uint32_t ms);
 
 private:
     void lock();
     void unlock();
+    void signal();
+
+    // The radio's modes, for callers already holding the lock. The public
+    // setters take it, they're called from the protocol thread and race
+    // with service() on the interrupt thread otherwise.
+    void enterRx();
+    void enterRxSingle(uint32_t timeout);
+    void enterIdle();
+    void enterTx();
+    void enterSleep();
+    bool checkRxTimedOut();
 
     uint8_t spiRead(int8_t address);
     void spiWrite(int8_t address, uint8_t value);
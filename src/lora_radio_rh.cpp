@@ -34,7 +34,7 @@ bool LoraRadioRadioHead::setup() {
 
     rf95.setTxPower(23, false);
     rf95.setModemConfig(RH_RF95::Bw125Cr45Sf128);
-    rf95.setModemConfig(RH_RF95::Bw500Cr45Sf128);
+    setModemConfig(&modemConfig_);
     rf95.spiWrite(RH_RF95_REG_23_MAX_PAYLOAD_LENGTH, 0xF2);
     rf95.setDeferIrqHandling();
 
@@ -73,6 +73,37 @@ bool LoraRadioRadioHead::hasPacket() {
     return rf95.available();
 }
 
+void LoraRadioRadioHead::setModemConfig(modem_config_t *config) {
+    RH_RF95::ModemConfig registers = { config->reg_1d, config->reg_1e, config->reg_26 };
+    rf95.setModemRegisters(&registers);
+    modemConfig_ = *config;
+}
+
+void LoraRadioRadioHead::setModeRxSingle(uint32_t timeout) {
+    auto symbols = loraSymbolTimeout(modemConfig_, timeout, preambleLength());
+    rf95.setModeIdle();
+    rf95.spiWrite(RH_RF95_REG_1E_MODEM_CONFIG2, (modemConfig_.reg_1e & 0xfc) | ((symbols >> 8) & 0x03));
+    rf95.spiWrite(RH_RF95_REG_1F_SYMB_TIMEOUT_LSB, symbols & 0xff);
+    rf95.setModeRxSingle();
+    rxSingle = true;
+}
+
+bool LoraRadioRadioHead::hasRxTimedOut() {
+    if (!rxSingle || !isModeRx()) {
+        rxSingle = false;
+        return false;
+    }
+    auto flags = rf95.spiRead(RH_RF95_REG_12_IRQ_FLAGS);
+    if ((flags & RH_RF95_RX_TIMEOUT) != RH_RF95_RX_TIMEOUT) {
+        return false;
+    }
+    rf95.spiWrite(RH_RF95_REG_12_IRQ_FLAGS, RH_RF95_RX_TIMEOUT);
+    // The radio is already in standby, this just lets RadioHead know.
+    rf95.setModeIdle();
+    rxSingle = false;
+    return true;
+}
+
 bool LoraRadioRadioHead::sendPacket(LoraPacket &packet) {
     rf95.setHeaderTo(packet.to);
     rf95.setHeaderFrom(packet.from);
@@ -10,13 +10,33 @@
 
 constexpr size_t FK_QUEUE_ENTRY_SIZE = 242;
 
+/**
+ * RH_RF95 that can also enter RXSINGLE directly while still handling RxDone
+ * as it would in continuous receive.
+ */
+class SingleReceiveRF95 : public RH_RF95 {
+public:
+    SingleReceiveRF95(uint8_t pinCs, uint8_t pinD0) : RH_RF95(pinCs, pinD0) {
+    }
+
+public:
+    void setModeRxSingle() {
+        spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x00); // IRQ on RxDone
+        spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_RXSINGLE);
+        _mode = RHModeRx;
+    }
+
+};
+
 class LoraRadioRadioHead : public PacketRadio {
 private:
-    RH_RF95 rf95;
+    SingleReceiveRF95 rf95;
+    modem_config_t modemConfig_ = LoraDefaultModemConfig;
     uint8_t pinCs;
     uint8_t pinReset;
     uint8_t pinEnable;
     bool available{ false };
+    bool rxSingle{ false };
 
 public:
     LoraRadioRadioHead(uint8_t pinCs, uint8_t pinD0, uint8_t pinEnable, uint8_t pinReset);
@@ -61,6 +81,16 @@ public:
         rf95.setModeRx();
     }
 
+    void setModeRxSingle(uint32_t timeout) override;
+
+    bool hasRxTimedOut() override;
+
+    modem_config_t modemConfig() override {
+        return modemConfig_;
+    }
+
+    void setModemConfig(modem_config_t *config);
+
     void setThisAddress(uint8_t value) {
         rf95.setThisAddress(value);
     }
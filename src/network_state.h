@@ -0,0 +1,77 @@
+#ifndef SLC_NETWORK_STATE_H_INCLUDED
+#define SLC_NETWORK_STATE_H_INCLUDED
+
+#include <cstddef>
+
+#include "logging.h"
+
+enum class NetworkState {
+    Starting,
+    ListenForSilence,
+    Idle,
+
+    Sleeping,
+    Appointment,
+    WaitingForSlot,
+    WaitingForBeacon,
+    ListenForBeacon,
+
+    PingGateway,
+    WaitingForPong,
+    SendPong,
+
+    Prepare,
+    WaitingForReady,
+    ReadData,
+    SendData,
+    WaitingForSendMore,
+    SendClose,
+    WaitingForClosed,
+    SendPriority,
+    WaitingForPriority,
+
+    Listening,
+    // Keep this last, it's how many states there are.
+    SendFailure,
+};
+
+constexpr size_t NumberOfNetworkStates = (size_t)NetworkState::SendFailure + 1;
+
+inline const char *getStateName(NetworkState state) {
+    switch (state) {
+    case NetworkState::Starting: return "Starting";
+    case NetworkState::ListenForSilence: return "ListenForSilence";
+    case NetworkState::Idle: return "Idle";
+    case NetworkState::Sleeping: return "Sleeping";
+    case NetworkState::Appointment: return "Appointment";
+    case NetworkState::WaitingForSlot: return "WaitingForSlot";
+    case NetworkState::WaitingForBeacon: return "WaitingForBeacon";
+    case NetworkState::ListenForBeacon: return "ListenForBeacon";
+
+    case NetworkState::PingGateway: return "PingGateway";
+    case NetworkState::WaitingForPong: return "WaitingForPong";
+    case NetworkState::SendPong: return "SendPong";
+
+    case NetworkState::Prepare: return "Prepare";
+    case NetworkState::WaitingForReady: return "WaitingForReady";
+    case NetworkState::ReadData: return "ReadData";
+    case NetworkState::SendData: return "SendData";
+    case NetworkState::WaitingForSendMore: return "WaitingForSendMore";
+    case NetworkState::SendClose: return "SendClose";
+    case NetworkState::WaitingForClosed: return "WaitingForClosed";
+    case NetworkState::SendPriority: return "SendPriority";
+    case NetworkState::WaitingForPriority: return "WaitingForPriority";
+
+    case NetworkState::Listening: return "Listening";
+    case NetworkState::SendFailure: return "SendFailure";
+    default: {
+        return "Unknown";
+    }
+    }
+}
+
+inline LogStream& operator<<(LogStream &log, const NetworkState &state) {
+    return log.print(getStateName(state));
+}
+
+#endif
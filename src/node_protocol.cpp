@@ -7,11 +7,201 @@ inline int32_t random(int32_t min, int32_t max) {
 #endif
 
 void NodeNetworkProtocol::sendToGateway() {
+    appointments = 0;
+    // Anything left open by a failed session starts over.
+    closeReader();
+    if (beacon.synchronized()) {
+        beaconDueAt = beacon.next(now());
+        auto wakeIn = beaconDueAt - beacon.guard(beaconDueAt) - now();
+        slc::logInfo() << "Sending: Beacon in " << wakeIn << "ms";
+        transition(NetworkState::WaitingForBeacon, wakeIn);
+        return;
+    }
     auto delay = random(IdleWindowMin, IdleWindowMax);
-    slc::log() << "Sending: Delay for " << delay;
+    slc::logInfo() << "Sending: Delay for " << delay;
     transition(NetworkState::Idle, delay);
 }
 
+bool NodeNetworkProtocol::sendPriority(const uint8_t *ptr, size_t size) {
+    if (prioritySize > 0 || size == 0 || size > MaximumPrioritySize) {
+        return false;
+    }
+    memcpy(priorityBuffer, ptr, size);
+    prioritySize = size;
+    priorityMessage++;
+    return true;
+}
+
+bool NodeNetworkProtocol::canInterrupt() {
+    // Anywhere we aren't waiting on a reply or halfway through sending.
+    switch (getState()) {
+    case NetworkState::Sleeping:
+    case NetworkState::Idle:
+    case NetworkState::ListenForSilence:
+    case NetworkState::Appointment:
+    case NetworkState::WaitingForSlot:
+    case NetworkState::WaitingForBeacon:
+    case NetworkState::ReadData:
+    case NetworkState::SendFailure:
+        return !getRadio()->isModeTx();
+    default:
+        return false;
+    }
+}
+
+void NodeNetworkProtocol::priorityDone() {
+    prioritySize = 0;
+    resume(interrupted);
+}
+
+void NodeNetworkProtocol::closeReader() {
+    if (reader != nullptr) {
+        callbacks->closeReader(reader);
+        reader = nullptr;
+    }
+}
+
+void NodeNetworkProtocol::heardBeacon(LoraPacket &lora, RadioPacket &packet) {
+    // Stamp it with when it started, which is when the gateway sent it.
+    auto at = now() - getRadio()->timeOnAir(lora);
+    if (!beacon.heard(at, packet.m().time, packet.m().epoch, packet.m().period)) {
+        slc::logInfo() << "Beacon: Gateway restarted";
+        phase = 0;
+    }
+    slc::logInfo() << "Beacon: Epoch " << packet.m().epoch << " drift " << beacon.drift() << "ppm";
+    if (getState() == NetworkState::ListenForBeacon) {
+        pingAfter(at);
+    }
+}
+
+void NodeNetworkProtocol::pingAfter(uint32_t beaconAt) {
+    if (phase == 0) {
+        auto delay = random(IdleWindowMin, IdleWindowMax);
+        transition(NetworkState::Idle, delay);
+        return;
+    }
+    // Our phase is ours, so there's no need to listen for silence first.
+    auto pingAt = beaconAt + phase;
+    transition(NetworkState::Appointment, (int32_t)(pingAt - now()) > 0 ? pingAt - now() : 1);
+}
+
+void NodeNetworkProtocol::expectReply() {
+    sentAt = 0;
+    replyWindowOpen = false;
+}
+
+void NodeNetworkProtocol::listenForReply() {
+    if (getRadio()->isModeTx()) {
+        return;
+    }
+
+    if (sentAt == 0) {
+        sentAt = now();
+        getRadio()->setModeIdle();
+    }
+
+    if (!replyWindowOpen) {
+        if (now() - sentAt >= ReplyDelay - ReplySlack) {
+            getRadio()->setModeRxSingle(replyWindowLength());
+            replyWindowOpen = true;
+        }
+    }
+    else if (getRadio()->hasRxTimedOut()) {
+        // The radio is idle again. We still wait out the rest of the receive
+        // window before retrying, as before.
+        slc::logInfo() << "Reply window closed";
+    }
+}
+
+uint32_t NodeNetworkProtocol::untilReply() {
+    auto timeout = untilInStateFor(receiveWindow());
+    if (replyWindowOpen && !getRadio()->isModeRx()) {
+        // Window closed empty, nothing until we give up on the reply.
+        return timeout;
+    }
+    if (sentAt == 0 || replyWindowOpen) {
+        // Waiting on TX done or on the RX-single window to close.
+        return timeout < PollInterval ? timeout : PollInterval;
+    }
+    auto opensIn = (int32_t)(sentAt + ReplyDelay - ReplySlack - now());
+    return opensIn > 0 ? (uint32_t)opensIn : 0;
+}
+
+uint32_t NodeNetworkProtocol::nextDeadline() {
+    if (hasPriority() && canInterrupt()) {
+        return 0;
+    }
+    if (getRadio()->isModeTx()) {
+        return PollInterval;
+    }
+    switch (getState()) {
+    case NetworkState::Sleeping:
+    case NetworkState::SendFailure: {
+        return Forever;
+    }
+    case NetworkState::Idle:
+    case NetworkState::Appointment:
+    case NetworkState::WaitingForSlot:
+    case NetworkState::WaitingForBeacon: {
+        return hasEntered() ? untilTimerDone() : 0;
+    }
+    case NetworkState::ListenForSilence: {
+        return hasEntered() ? untilInStateFor(ListenForSilenceWindowLength) : 0;
+    }
+    case NetworkState::ListenForBeacon: {
+        auto timeout = untilTimerDone();
+        return timeout < PollInterval ? timeout : PollInterval;
+    }
+    case NetworkState::WaitingForSendMore: {
+        if (!readAheadDone) {
+            return 0;
+        }
+        return untilReply();
+    }
+    case NetworkState::WaitingForPong:
+    case NetworkState::WaitingForReady:
+    case NetworkState::WaitingForClosed:
+    case NetworkState::WaitingForPriority: {
+        return untilReply();
+    }
+    default: {
+        // Sending, or about to. Only the duty cycle holds us up here.
+        return wasDeferred() ? DeferredPollInterval : 0;
+    }
+    }
+}
+
+bool NodeNetworkProtocol::comeBackLater(RadioPacket &packet) {
+    if (packet.m().kind != fk_radio_PacketKind_NACK || packet.getNodeId() != nodeId || packet.m().backoff == 0) {
+        return false;
+    }
+
+    retries().clear();
+    if (++appointments > MaximumRetries) {
+        slc::logErrors() << "Busy: FAIL!";
+        transition(NetworkState::SendFailure);
+        return true;
+    }
+
+    slc::logInfo() << "Busy: Back in " << packet.m().backoff << "ms";
+    transition(NetworkState::Appointment, packet.m().backoff);
+    return true;
+}
+
+bool NodeNetworkProtocol::refused(RadioPacket &packet) {
+    if (packet.m().kind != fk_radio_PacketKind_NACK || packet.getNodeId() != nodeId || packet.m().backoff != 0) {
+        return false;
+    }
+
+    slc::logErrors() << "Refused: FAIL!";
+    transition(NetworkState::SendFailure);
+    return true;
+}
+
+bool NodeNetworkProtocol::isUploadAck(RadioPacket &packet) {
+    return packet.m().kind == fk_radio_PacketKind_ACK && packet.m().message == 0;
+}
+
 void NodeNetworkProtocol::tick() {
     if (getRadio()->isModeTx()) {
         if (!transmitting.isRunning()) {
@@ -21,6 +211,11 @@ void NodeNetworkProtocol::tick() {
     else if (transmitting.isRunning()) {
         transmitting.end();
     }
+    if (hasPriority() && canInterrupt()) {
+        interrupted = suspend();
+        priorityRetries.clear();
+        transition(NetworkState::SendPriority);
+    }
     switch (getState()) {
     case NetworkState::Starting: {
         retries().clear();
@@ -28,83 +223,157 @@ void NodeNetworkProtocol::tick() {
         break;
     }
     case NetworkState::Idle: {
-        getRadio()->setModeIdle();
+        if (entering()) {
+            getRadio()->setModeIdle();
+        }
         if (isTimerDone()) {
             transition(NetworkState::ListenForSilence);
         }
         break;
     }
     case NetworkState::Sleeping: {
-        getRadio()->sleep();
+        if (entering()) {
+            getRadio()->sleep();
+        }
+        break;
+    }
+    case NetworkState::Appointment: {
+        if (entering()) {
+            getRadio()->sleep();
+        }
+        if (isTimerDone()) {
+            transition(NetworkState::PingGateway);
+        }
+        break;
+    }
+    case NetworkState::WaitingForSlot: {
+        if (entering()) {
+            getRadio()->sleep();
+        }
+        if (isTimerDone()) {
+            transition(NetworkState::Prepare);
+        }
+        break;
+    }
+    case NetworkState::WaitingForBeacon: {
+        if (entering()) {
+            getRadio()->sleep();
+        }
+        if (isTimerDone()) {
+            auto window = 2 * beacon.guard(beaconDueAt);
+            getRadio()->setModeRxSingle(window);
+            transition(NetworkState::ListenForBeacon, window + receiveWindow());
+        }
+        break;
+    }
+    case NetworkState::ListenForBeacon: {
+        // Something else may have been heard in the window and left the
+        // radio idle, in which case we wait the window out.
+        if (getRadio()->hasRxTimedOut() || isTimerDone()) {
+            if (beacon.missed()) {
+                slc::logInfo() << "Beacon: Missed";
+                pingAfter(beaconDueAt);
+            }
+            else {
+                slc::logInfo() << "Beacon: Lost";
+                phase = 0;
+                sendToGateway();
+            }
+        }
         break;
     }
     case NetworkState::ListenForSilence: {
-        retries().clear();
-        getRadio()->setModeRx();
+        if (entering()) {
+            retries().clear();
+        }
+        // Receiving anything leaves the radio idle.
+        if (!getRadio()->isModeRx()) {
+            getRadio()->setModeRx();
+        }
         if (inStateFor(ListenForSilenceWindowLength)) {
             transition(NetworkState::PingGateway);
         }
         break;
     }
     case NetworkState::PingGateway: {
-        sendPacket(RadioPacket{ fk_radio_PacketKind_PING, nodeId });
+        auto ping = RadioPacket{ fk_radio_PacketKind_PING, nodeId };
+        ping.m().size = callbacks->pendingSize();
+        if (!sendPacket(std::move(ping))) {
+            break;
+        }
+        expectReply();
         transition(NetworkState::WaitingForPong);
         break;
     }
     case NetworkState::WaitingForPong: {
-        if (!getRadio()->isModeTx()) {
-            getRadio()->setModeRx();
-        }
-        if (inStateFor(ReceiveWindowLength)) {
+        listenForReply();
+        if (inStateFor(receiveWindow())) {
             if (retries().canRetry()) {
-                slc::log() << "RETRY!";
+                slc::logInfo() << "RETRY!";
                 transition(NetworkState::PingGateway);
             }
             else {
-                slc::log() << "FAIL!";
+                slc::logErrors() << "FAIL!";
                 transition(NetworkState::SendFailure);
             }
         }
         break;
     }
     case NetworkState::Prepare: {
-        if (reader != nullptr) {
-            callbacks->closeReader(reader);
+        // Later files in the session are opened as the one before closes.
+        if (reader == nullptr) {
+            auto opened = callbacks->openReader();
+            reader = opened.reader;
+            readerSize = opened.size;
         }
-        auto opened = callbacks->openReader();
         auto prepare = RadioPacket{ fk_radio_PacketKind_PREPARE, nodeId };
-        prepare.m().size = opened.size;
-        reader = opened.reader;
-        sendPacket(std::move(prepare));
+        prepare.m().size = readerSize;
+        current = 0;
+        readAhead = 0;
+        readAheadDone = false;
+        if (!sendPacket(std::move(prepare))) {
+            break;
+        }
+        expectReply();
         transition(NetworkState::WaitingForReady);
         waitingOnAck.begin();
         break;
     }
     case NetworkState::WaitingForReady: {
-        if (!getRadio()->isModeTx()) {
-            getRadio()->setModeRx();
-        }
-        if (inStateFor(ReceiveWindowLength)) {
+        listenForReply();
+        if (inStateFor(receiveWindow())) {
             if (retries().canRetry()) {
-                slc::log() << "RETRY!";
+                slc::logInfo() << "RETRY!";
                 transition(NetworkState::Prepare);
             }
             else {
-                slc::log() << "FAIL!";
+                slc::logErrors() << "FAIL!";
                 transition(NetworkState::SendFailure);
             }
         }
         break;
     }
     case NetworkState::ReadData: {
-        auto bp = buffer.toBufferPtr();
-        auto bytes = reader->read(bp.ptr, bp.size);
+        auto bytes = readAhead;
+        if (bytes != 0) {
+            current ^= 1;
+            readAhead = 0;
+        }
+        else {
+            auto bp = buffer().toBufferPtr();
+            bytes = reader->read(bp.ptr, bp.size);
+        }
+        readAheadDone = false;
         if (bytes < 0) {
             transition(NetworkState::SendClose);
-            slc::log() << "Done! waitingOnAck: " << waitingOnAck << " transmitting: " << transmitting;
+            slc::logInfo() << "Done! waitingOnAck: " << waitingOnAck << " transmitting: " << transmitting;
         }
         else if (bytes >= 0) {
-            buffer.position(bytes);
+            if (slotEndsAt > 0 && (int32_t)(now() - slotEndsAt) > 0) {
+                slc::logInfo() << "Slot overrun";
+                slotEndsAt = 0;
+            }
+            buffer().position(bytes);
             if (bytes > 0) {
                 transition(NetworkState::SendData);
             }
@@ -113,23 +382,30 @@ void NodeNetworkProtocol::tick() {
     }
     case NetworkState::SendData: {
         auto packet = RadioPacket{ fk_radio_PacketKind_DATA, nodeId };
-        packet.data(buffer.toBufferPtr().ptr, buffer.position());
-        sendPacket(std::move(packet));
+        packet.data(buffer().toBufferPtr().ptr, buffer().position());
+        packet.m().offset = offset;
+        if (!sendPacket(std::move(packet))) {
+            break;
+        }
+        expectReply();
         transition(NetworkState::WaitingForSendMore);
         waitingOnAck.begin();
         break;
     }
     case NetworkState::WaitingForSendMore: {
-        if (!getRadio()->isModeTx()) {
-            getRadio()->setModeRx();
+        listenForReply();
+        if (!readAheadDone) {
+            auto bp = buffers[current ^ 1].toBufferPtr();
+            readAhead = reader->read(bp.ptr, bp.size);
+            readAheadDone = true;
         }
-        if (inStateFor(ReceiveWindowLength)) {
+        if (inStateFor(receiveWindow())) {
             if (retries().canRetry()) {
-                slc::log() << "RETRY!";
+                slc::logInfo() << "RETRY!";
                 transition(NetworkState::SendData);
             }
             else {
-                slc::log() << "FAIL!";
+                slc::logErrors() << "FAIL!";
                 transition(NetworkState::SendFailure);
             }
         }
@@ -137,27 +413,55 @@ void NodeNetworkProtocol::tick() {
     }
     case NetworkState::SendClose: {
         auto packet = RadioPacket{ fk_radio_PacketKind_DATA, nodeId };
-        sendPacket(std::move(packet));
+        packet.m().offset = offset;
+        packet.m().more = callbacks->hasNextReader();
+        if (!sendPacket(std::move(packet))) {
+            break;
+        }
+        expectReply();
         transition(NetworkState::WaitingForClosed);
         waitingOnAck.begin();
         break;
     }
     case NetworkState::WaitingForClosed: {
-        if (!getRadio()->isModeTx()) {
-            getRadio()->setModeRx();
-        }
-        if (inStateFor(ReceiveWindowLength)) {
+        listenForReply();
+        if (inStateFor(receiveWindow())) {
             if (retries().canRetry()) {
-                slc::log() << "RETRY!";
+                slc::logInfo() << "RETRY!";
                 transition(NetworkState::SendClose);
             }
             else {
-                slc::log() << "FAIL!";
+                slc::logErrors() << "FAIL!";
                 transition(NetworkState::SendFailure);
             }
         }
         break;
     }
+    case NetworkState::SendPriority: {
+        auto packet = RadioPacket{ fk_radio_PacketKind_PRIORITY, nodeId };
+        packet.data(priorityBuffer, prioritySize);
+        packet.m().message = priorityMessage;
+        if (!sendPacket(std::move(packet))) {
+            break;
+        }
+        expectReply();
+        transition(NetworkState::WaitingForPriority);
+        break;
+    }
+    case NetworkState::WaitingForPriority: {
+        listenForReply();
+        if (inStateFor(receiveWindow())) {
+            if (priorityRetries.canRetry()) {
+                slc::logInfo() << "Priority: RETRY!";
+                transition(NetworkState::SendPriority);
+            }
+            else {
+                slc::logErrors() << "Priority: FAIL!";
+                priorityDone();
+            }
+        }
+        break;
+    }
     default: {
         break;
     }
@@ -167,12 +471,19 @@ void NodeNetworkProtocol::tick() {
 void NodeNetworkProtocol::push(LoraPacket &lora) {
     auto packet = RadioPacket{ };
     if (!packet.decode(lora)) {
-        slc::log() << "Unable to decode packet!";
+        slc::logErrors() << "Unable to decode packet!";
         return;
     }
-    auto traffic = packet.m().kind != fk_radio_PacketKind_ACK && packet.getNodeId() != nodeId;
+    auto beaconed = packet.m().kind == fk_radio_PacketKind_BEACON;
+    auto traffic = packet.m().kind != fk_radio_PacketKind_ACK && !beaconed && packet.getNodeId() != nodeId;
 
-    slc::log() << "R " << lora.id << " " << packet.m().kind << " (" << lora.size << " bytes)" << (traffic ? " TRAFFIC" : "");
+    trace().record(now(), TraceEvent::Received, packet.m().kind, lora.size);
+    slc::logFrames() << "R " << lora.id << " " << packet.m().kind << " (" << lora.size << " bytes)" << (traffic ? " TRAFFIC" : "");
+
+    if (beaconed) {
+        heardBeacon(lora, packet);
+        return;
+    }
 
     switch (getState()) {
     case NetworkState::ListenForSilence: {
@@ -184,37 +495,82 @@ void NodeNetworkProtocol::push(LoraPacket &lora) {
     }
     case NetworkState::WaitingForPong: {
         if (packet.m().kind == fk_radio_PacketKind_PONG) {
+            // Slots are booked for several nodes at once, don't take theirs.
+            if (packet.getNodeId() != nodeId) {
+                break;
+            }
             retries().clear();
-            slc::log() << "Pong: My address: " << packet.m().address;
-            transition(NetworkState::Prepare);
+            appointments = 0;
+            slotEndsAt = packet.m().window > 0 ? now() + packet.m().slot + packet.m().window : 0;
+            phase = packet.m().phase;
+            slc::logInfo() << "Pong: My address: " << packet.m().address << " slot in " << packet.m().slot << "ms for " << packet.m().window << "ms";
+            if (packet.m().slot > 0) {
+                transition(NetworkState::WaitingForSlot, packet.m().slot);
+            }
+            else {
+                transition(NetworkState::Prepare);
+            }
+        }
+        else {
+            comeBackLater(packet);
         }
         break;
     }
     case NetworkState::WaitingForReady: {
-        if (packet.m().kind == fk_radio_PacketKind_ACK) {
+        if (comeBackLater(packet) || refused(packet)) {
+            break;
+        }
+        if (isUploadAck(packet)) {
             waitingOnAck.end();
             zeroSequence();
             bumpSequence();
+            offset = 0;
             retries().clear();
             transition(NetworkState::ReadData);
         }
         break;
     }
     case NetworkState::WaitingForSendMore: {
-        if (packet.m().kind == fk_radio_PacketKind_ACK) {
+        if (refused(packet)) {
+            break;
+        }
+        if (isUploadAck(packet)) {
             waitingOnAck.end();
             bumpSequence();
+            offset += buffer().position();
             retries().clear();
             transition(NetworkState::ReadData);
         }
         break;
     }
+    case NetworkState::WaitingForPriority: {
+        if (packet.m().kind == fk_radio_PacketKind_ACK && packet.getNodeId() == nodeId && packet.m().message == priorityMessage) {
+            slc::logInfo() << "Priority: Delivered";
+            priorityDone();
+        }
+        break;
+    }
     case NetworkState::WaitingForClosed: {
-        if (packet.m().kind == fk_radio_PacketKind_ACK) {
+        if (refused(packet)) {
+            break;
+        }
+        if (isUploadAck(packet)) {
             waitingOnAck.end();
             bumpSequence();
             retries().clear();
-            transition(NetworkState::Sleeping);
+            closeReader();
+            if (callbacks->hasNextReader()) {
+                auto opened = callbacks->nextReader();
+                reader = opened.reader;
+                readerSize = opened.size;
+            }
+            if (reader != nullptr) {
+                slc::logInfo() << "Next file (" << readerSize << " bytes)";
+                transition(NetworkState::Prepare);
+            }
+            else {
+                transition(NetworkState::Sleeping);
+            }
         }
         break;
     }
@@ -224,6 +580,6 @@ void NodeNetworkProtocol::push(LoraPacket &lora) {
     }
 
     #ifdef ARDUINO
-    randomSeed(millis());
+    randomSeed(now());
     #endif
 }
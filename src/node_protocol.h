@@ -2,6 +2,7 @@
 #define SLC_NODE_PROTOCOL_H_INCLUDED
 
 #include "protocol.h"
+#include "beacon_tracker.h"
 
 template<size_t Size>
 struct HoldingBuffer {
@@ -32,20 +33,82 @@ public:
     };
 
 public:
+    /**
+     * Bytes we'd upload if asked now, across every file, announced when we
+     * PING so the gateway can size our slot. 0 if unknown.
+     */
+    virtual size_t pendingSize() {
+        return 0;
+    }
+
+    /**
+     * The first file of a session.
+     */
     virtual OpenedReader openReader() = 0;
     virtual void closeReader(lws::Reader *reader) = 0;
 
+    /**
+     * True if another file should follow the one being sent, in the same
+     * session.
+     */
+    virtual bool hasNextReader() {
+        return false;
+    }
+
+    /**
+     * The next file of a session. Only called once the gateway has committed
+     * the one before it.
+     */
+    virtual OpenedReader nextReader() {
+        return OpenedReader{ nullptr, 0 };
+    }
+
 };
 
 class NodeNetworkProtocol : public NetworkProtocol {
+public:
+    static constexpr size_t MaximumPrioritySize = 64;
+
 private:
     NodeNetworkCallbacks *callbacks{ nullptr };
     NodeLoraId nodeId;
-    HoldingBuffer<242 - 24> buffer;
+    // The frame being sent, and the next one read ahead while we wait for
+    // the ACK so a slow reader doesn't add to every round trip.
+    HoldingBuffer<MaximumDataSize> buffers[2];
+    uint8_t current{ 0 };
+    // What reading ahead returned, which can be 0 or the end of the file,
+    // and whether we've read ahead for the frame in flight yet.
+    int32_t readAhead{ 0 };
+    bool readAheadDone{ false };
     lws::Reader *reader{ nullptr };
+    size_t readerSize{ 0 };
+    // When our last frame finished going out, 0 while it's still going.
+    uint32_t sentAt{ 0 };
+    bool replyWindowOpen{ false };
+    // Times the gateway has told us to come back later this attempt.
+    uint8_t appointments{ 0 };
+    // When the slot the gateway gave us ends, 0 if we don't have one.
+    uint32_t slotEndsAt{ 0 };
+    // Bytes the gateway has ACK'd, sent with each DATA frame.
+    uint32_t offset{ 0 };
+    BeaconTracker beacon;
+    // When the beacon we're waking for is due.
+    uint32_t beaconDueAt{ 0 };
+    // How long after a beacon the gateway wants us to PING, 0 if it hasn't
+    // said and we have to contend for the channel like everybody else.
+    uint32_t phase{ 0 };
+    // The PRIORITY message waiting to go, and what it interrupted.
+    uint8_t priorityBuffer[MaximumPrioritySize];
+    size_t prioritySize{ 0 };
+    uint32_t priorityMessage{ 0 };
+    RetryCounter priorityRetries;
+    Suspended interrupted;
+    Timer transmitting;
+    Timer waitingOnAck;
 
 public:
-    NodeNetworkProtocol(PacketRadio &radio, NodeNetworkCallbacks &callbacks) : NetworkProtocol(radio), callbacks(&callbacks) {
+    NodeNetworkProtocol(PacketRadio &radio, NodeNetworkCallbacks &callbacks, Clock &clock = slc::systemClock)
+        : NetworkProtocol(radio, clock), callbacks(&callbacks), transmitting(clock), waitingOnAck(clock) {
     }
 
 public:
@@ -58,6 +121,52 @@ public:
     void push(LoraPacket &lora);
     void sendToGateway();
 
+    /**
+     * How long the caller can leave it before calling tick() again, unless
+     * the radio receives something first. 0 if tick() has work to do now.
+     * Forever while sleeping, until the caller decides to send.
+     */
+    uint32_t nextDeadline();
+
+    /**
+     * Queues a small, urgent message. It goes out between DATA frames if
+     * we're uploading, or straight away if we're not, and is delivered to
+     * the gateway's priority() callback instead of a file. Returns false if
+     * one is already waiting or it's too big.
+     */
+    bool sendPriority(const uint8_t *ptr, size_t size);
+
+    bool hasPriority() {
+        return prioritySize > 0;
+    }
+
+private:
+    void expectReply();
+    void listenForReply();
+    uint32_t untilReply();
+    bool comeBackLater(RadioPacket &packet);
+
+    /**
+     * True for an ACK that could be for our upload, rather than the reply
+     * to someone's PRIORITY message.
+     */
+    bool isUploadAck(RadioPacket &packet);
+
+    /**
+     * True, after failing the attempt, if the gateway NACK'd us without an
+     * appointment because it won't take this upload.
+     */
+    bool refused(RadioPacket &packet);
+    void heardBeacon(LoraPacket &lora, RadioPacket &packet);
+    void pingAfter(uint32_t beaconAt);
+    void closeReader();
+    bool canInterrupt();
+    void priorityDone();
+
+    HoldingBuffer<MaximumDataSize> &buffer() {
+        return buffers[current];
+    }
+
 };
 
 #endif
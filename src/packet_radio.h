@@ -1,7 +1,9 @@
 #ifndef SLC_PACKET_RADIO_H_INCLUDED
 #define SLC_PACKET_RADIO_H_INCLUDED
 
+#include "logging.h"
 #include "packets.h"
+#include "airtime.h"
 
 constexpr float LoraRadioFrequency = 915.0;
 constexpr uint8_t LoraRadioMaximumRetries = 3;
@@ -17,12 +19,50 @@ public:
     virtual bool sendPacket(LoraPacket &packet) = 0 ;
     virtual void setThisAddress(uint8_t address) = 0;
 
-};
+    /**
+     * Listens for a single frame, with the radio giving up and going idle on
+     * its own if no preamble starts within about timeout ms. Radios that
+     * can't do that just listen.
+     */
+    virtual void setModeRxSingle(uint32_t timeout) {
+        setModeRx();
+    }
+
+    /**
+     * True, once, after a window opened by setModeRxSingle closed without
+     * hearing anything.
+     */
+    virtual bool hasRxTimedOut() {
+        return false;
+    }
+
+    virtual modem_config_t modemConfig() {
+        return LoraDefaultModemConfig;
+    }
 
-namespace slc {
+    virtual uint16_t preambleLength() {
+        return LoraDefaultPreambleLength;
+    }
 
-extern Logger log;
+    /**
+     * Milliseconds the given frame will occupy the channel, rounded up.
+     */
+    uint32_t timeOnAir(int32_t size) {
+        auto us = loraTimeOnAir(modemConfig(), size + LoraPacket::SX1272_HEADER_LENGTH, preambleLength());
+        return (us + 999) / 1000;
+    }
 
-}
+    uint32_t timeOnAir(LoraPacket &packet) {
+        return timeOnAir(packet.size);
+    }
+
+    /**
+     * Milliseconds a receiver needs to catch a frame's preamble, rounded up.
+     */
+    uint32_t preambleTime() {
+        return (loraPreambleTime(modemConfig(), preambleLength()) + 999) / 1000;
+    }
+
+};
 
 #endif
@@ -53,6 +53,8 @@ inline LogStream& operator<<(LogStream &log, const fk_radio_PacketKind &kind) {
     case fk_radio_PacketKind_PONG: return log.print("Pong");
     case fk_radio_PacketKind_PREPARE: return log.print("Prepare");
     case fk_radio_PacketKind_DATA: return log.print("Data");
+    case fk_radio_PacketKind_BEACON: return log.print("Beacon");
+    case fk_radio_PacketKind_PRIORITY: return log.print("Priority");
     default:
         return log.print("Unknown");
     }
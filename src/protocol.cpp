@@ -4,9 +4,6 @@
 
 #include "protocol.h"
 
-Timer transmitting;
-Timer waitingOnAck;
-
 bool NetworkProtocol::sendPacket(RadioPacket &&packet) {
     size_t required = 0;
     if (!pb_get_encoded_size(&required, fk_radio_RadioPacket_fields, packet.forEncode())) {
@@ -23,7 +20,16 @@ bool NetworkProtocol::sendPacket(RadioPacket &&packet) {
     lora.id = sequence;
     memcpy(lora.data, buffer, stream.bytes_written);
     lora.size = stream.bytes_written;
-    slc::log() << "S " << packet.m().kind << " " << packet.getNodeId() << " " << lora.id << " (" << stream.bytes_written << " bytes)";
+    if (!reserveAirtime(lora)) {
+        // A late beacon would carry the wrong time.
+        if (packet.m().kind != fk_radio_PacketKind_BEACON && hold(lora, packet.m().kind)) {
+            trace_.record(now(), TraceEvent::Deferred, packet.m().kind, dutyCycle_.used());
+            slc::logFrames() << "S " << packet.m().kind << " " << packet.getNodeId() << " DEFER (" << dutyCycle_.used() << "/" << dutyCycle_.budget() << "ms)";
+        }
+        return false;
+    }
+    trace_.record(now(), TraceEvent::Sent, packet.m().kind, stream.bytes_written);
+    slc::logFrames() << "S " << packet.m().kind << " " << packet.getNodeId() << " " << lora.id << " (" << stream.bytes_written << " bytes)";
     return radio->sendPacket(lora);
 }
 
@@ -33,17 +39,72 @@ bool NetworkProtocol::sendAck(uint8_t toAddress) {
     ack.to = toAddress;
     ack.flags = 1;
     ack.size = 0;
+    if (!reserveAirtime(ack)) {
+        if (hold(ack, fk_radio_PacketKind_ACK)) {
+            trace_.record(now(), TraceEvent::Deferred, fk_radio_PacketKind_ACK, dutyCycle_.used());
+            slc::logFrames() << "S Ack DEFER (" << dutyCycle_.used() << "/" << dutyCycle_.budget() << "ms)";
+        }
+        return false;
+    }
+    trace_.record(now(), TraceEvent::Ack, toAddress);
     return radio->sendPacket(ack);
 }
 
-void NetworkProtocol::transition(NetworkState newState, uint32_t timer) {
-    lastTransitionAt = millis();
-    if (false) {
-        slc::log() << getStateName(state) << " -> " << getStateName(newState);
+bool NetworkProtocol::sendDeferred() {
+    if (!deferred) {
+        return false;
+    }
+    if ((int32_t)(now() - heldUntil) > 0) {
+        deferred = false;
+        slc::logFrames() << "S " << heldKind << " DEFER expired";
+        return false;
+    }
+    if (!reserveAirtime(held)) {
+        return false;
+    }
+    if (held.size == 0) {
+        trace_.record(now(), TraceEvent::Ack, held.to);
+    }
+    else {
+        trace_.record(now(), TraceEvent::Sent, heldKind, held.size);
+    }
+    slc::logFrames() << "S " << heldKind << " " << held.id << " (" << held.size << " bytes) DEFERRED";
+    return radio->sendPacket(held);
+}
+
+bool NetworkProtocol::hold(LoraPacket &lora, fk_radio_PacketKind kind) {
+    auto again = deferred && held.to == lora.to && held.id == lora.id && held.size == lora.size &&
+        memcmp(held.data, lora.data, lora.size) == 0;
+    if (again) {
+        return false;
+    }
+    held = lora;
+    heldKind = kind;
+    heldUntil = now() + receiveWindow();
+    deferred = true;
+    return true;
+}
+
+bool NetworkProtocol::reserveAirtime(LoraPacket &lora) {
+    auto airtime = radio->timeOnAir(lora);
+    if (!dutyCycle_.canTransmit(now(), airtime)) {
+        return false;
     }
+    dutyCycle_.record(now(), airtime);
+    // Whatever was held back is superseded.
+    deferred = false;
+    return true;
+}
+
+void NetworkProtocol::transition(NetworkState newState, uint32_t timer) {
+    auto elapsed = now() - lastTransitionAt;
+    stateStats_.record(state, elapsed);
+    trace_.record(now(), TraceEvent::Transition, ((uint16_t)state << 8) | (uint16_t)newState, elapsed);
+    lastTransitionAt = now();
     state = newState;
+    entered = false;
     if (timer > 0) {
-        timerDoneAt = millis() + timer;
+        timerDoneAt = now() + timer;
     }
     else {
         timerDoneAt = 0;
@@ -51,9 +112,40 @@ void NetworkProtocol::transition(NetworkState newState, uint32_t timer) {
 }
 
 bool NetworkProtocol::isTimerDone() {
-    return timerDoneAt > 0 && millis() > timerDoneAt;
+    return timerDoneAt > 0 && now() > timerDoneAt;
 }
 
 bool NetworkProtocol::inStateFor(uint32_t ms) {
-    return millis() - lastTransitionAt > ms;
+    return now() - lastTransitionAt > ms;
+}
+
+bool NetworkProtocol::entering() {
+    if (entered) {
+        return false;
+    }
+    entered = true;
+    return true;
+}
+
+uint32_t NetworkProtocol::untilTimerDone() {
+    if (timerDoneAt == 0) {
+        return Forever;
+    }
+    // isTimerDone() wants us strictly past it.
+    auto remaining = (int32_t)(timerDoneAt - now()) + 1;
+    return remaining > 0 ? remaining : 0;
+}
+
+uint32_t NetworkProtocol::untilInStateFor(uint32_t ms) {
+    auto remaining = (int32_t)(lastTransitionAt + ms - now()) + 1;
+    return remaining > 0 ? remaining : 0;
+}
+
+uint32_t NetworkProtocol::receiveWindow() {
+    auto window = ReplyDelay + 2 * radio->timeOnAir(MaximumFrameSize) + ReceiveWindowMargin;
+    return window > ReceiveWindowLength ? window : ReceiveWindowLength;
+}
+
+uint32_t NetworkProtocol::replyWindowLength() {
+    return 2 * ReplySlack + radio->preambleTime();
 }
@@ -10,63 +10,18 @@
 
 #include "device_id.h"
 #include "packet_radio.h"
+#include "clock.h"
 #include "timer.h"
-
-enum class NetworkState {
-    Starting,
-    ListenForSilence,
-    Idle,
-
-    Sleeping,
-
-    PingGateway,
-    WaitingForPong,
-    SendPong,
-
-    Prepare,
-    WaitingForReady,
-    ReadData,
-    SendData,
-    WaitingForSendMore,
-    SendClose,
-    WaitingForClosed,
-
-    Listening,
-    SendFailure,
-};
-
-inline const char *getStateName(NetworkState state) {
-    switch (state) {
-    case NetworkState::Starting: return "Starting";
-    case NetworkState::ListenForSilence: return "ListenForSilence";
-    case NetworkState::Idle: return "Idle";
-    case NetworkState::Sleeping: return "Sleeping";
-
-    case NetworkState::PingGateway: return "PingGateway";
-    case NetworkState::WaitingForPong: return "WaitingForPong";
-    case NetworkState::SendPong: return "SendPong";
-
-    case NetworkState::Prepare: return "Prepare";
-    case NetworkState::WaitingForReady: return "WaitingForReady";
-    case NetworkState::ReadData: return "ReadData";
-    case NetworkState::SendData: return "SendData";
-    case NetworkState::WaitingForSendMore: return "WaitingForSendMore";
-    case NetworkState::SendClose: return "SendClose";
-    case NetworkState::WaitingForClosed: return "WaitingForClosed";
-
-    case NetworkState::Listening: return "Listening";
-    case NetworkState::SendFailure: return "SendFailure";
-    default: {
-        return "Unknown";
-    }
-    }
-}
-
-inline LogStream& operator<<(LogStream &log, const NetworkState &state) {
-    return log.print(getStateName(state));
-}
+#include "trace.h"
+#include "network_state.h"
+#include "state_stats.h"
 
 class NetworkProtocol {
+public:
+    // From nextDeadline(), when only a radio event or a call from outside
+    // (sendToGateway(), say) will give tick() anything to do.
+    static constexpr uint32_t Forever = UINT32_MAX;
+
 protected:
     static constexpr uint32_t ReceiveWindowLength = 1000;
     static constexpr uint32_t ReplyDelay = 50;
@@ -74,6 +29,18 @@ protected:
     static constexpr uint32_t IdleWindowMax = 1600;
     static constexpr uint32_t ListenForSilenceWindowLength = 5000;
     static constexpr uint32_t MaximumRetries = 5;
+    static constexpr int32_t MaximumFrameSize = 242;
+    // Room left for DATA once the rest of a RadioPacket is encoded.
+    static constexpr int32_t MaximumDataSize = MaximumFrameSize - 24;
+    static constexpr uint32_t ReceiveWindowMargin = 100;
+    // Replies start ReplyDelay after our frame ends, give or take this much
+    // for either side's loop, see replyWindowLength().
+    static constexpr uint32_t ReplySlack = 25;
+    // How often to look in on a radio that won't tell us it's finished, as
+    // when transmitting or with an RX-single window open.
+    static constexpr uint32_t PollInterval = 10;
+    // Until the duty cycle budget frees up.
+    static constexpr uint32_t DeferredPollInterval = 100;
 
     struct RetryCounter {
         uint8_t counter{ 0 };
@@ -92,16 +59,35 @@ protected:
         }
     };
 
+    /**
+     * Where a state was left, so it can be picked back up after a detour.
+     */
+    struct Suspended {
+        NetworkState state;
+        uint32_t lastTransitionAt;
+        uint32_t timerDoneAt;
+    };
+
 private:
     PacketRadio *radio;
+    Clock *clock;
     NetworkState state{ NetworkState::Starting };
     uint32_t lastTransitionAt{ 0 };
     uint32_t timerDoneAt{ 0 };
+    bool entered{ false };
+    // The frame the duty cycle last held back, see sendDeferred().
+    bool deferred{ false };
+    LoraPacket held;
+    fk_radio_PacketKind heldKind{ fk_radio_PacketKind_ACK };
+    uint32_t heldUntil{ 0 };
     uint8_t sequence{ 0 };
     RetryCounter retryCounter;
+    DutyCycle dutyCycle_;
+    StateStats stateStats_;
+    TraceRing trace_;
 
 public:
-    NetworkProtocol(PacketRadio &radio) : radio(&radio) {
+    NetworkProtocol(PacketRadio &radio, Clock &clock = slc::systemClock) : radio(&radio), clock(&clock) {
     }
 
 public:
@@ -115,6 +101,31 @@ public:
 
     bool inStateFor(uint32_t ms);
 
+    /**
+     * How long until inStateFor(ms).
+     */
+    uint32_t untilInStateFor(uint32_t ms);
+
+    /**
+     * True on the first call after each transition, for work that only has
+     * to happen when a state is entered.
+     */
+    bool entering();
+
+    /**
+     * How long to wait for a reply to a frame we just sent: our own frame
+     * going out, the other side's reply delay and its reply coming back, all
+     * at the current data rate. Never shorter than ReceiveWindowLength.
+     */
+    uint32_t receiveWindow();
+
+    /**
+     * How long to listen for the start of a reply, opening ReplySlack before
+     * it's due: the slack either side and its preamble at the current data
+     * rate, after which the radio can go back to idle.
+     */
+    uint32_t replyWindowLength();
+
     void zeroSequence() {
         sequence = 0;
     }
@@ -136,6 +147,25 @@ public:
         return isSleeping() && inStateFor(ms);
     }
 
+    DutyCycle &dutyCycle() {
+        return dutyCycle_;
+    }
+
+    /**
+     * Time spent in each state so far, up to the last transition.
+     */
+    StateStats &stateStats() {
+        return stateStats_;
+    }
+
+    /**
+     * This protocol's recent events, for the main loop to dump when it
+     * wants to know what happened.
+     */
+    TraceRing &trace() {
+        return trace_;
+    }
+
 protected:
     RetryCounter &retries() {
         return retryCounter;
@@ -145,13 +175,71 @@ protected:
         return state;
     }
 
+    Suspended suspend() {
+        return Suspended{ state, lastTransitionAt, timerDoneAt };
+    }
+
+    /**
+     * Goes back to a suspended state as though we'd never left, timers and
+     * all.
+     */
+    void resume(Suspended &suspended) {
+        // The detour is also counted again in the suspended state's time.
+        stateStats_.record(state, now() - lastTransitionAt);
+        state = suspended.state;
+        lastTransitionAt = suspended.lastTransitionAt;
+        timerDoneAt = suspended.timerDoneAt;
+        entered = false;
+    }
+
+    /**
+     * How long until isTimerDone(), Forever without a timer.
+     */
+    uint32_t untilTimerDone();
+
+    /**
+     * True if the last frame we tried to send was held back by the duty
+     * cycle.
+     */
+    bool wasDeferred() {
+        return deferred;
+    }
+
+    /**
+     * Sends the frame the duty cycle held back, once there's budget for it.
+     * It's dropped once the other side will have given up waiting for it,
+     * and replaced by anything sent after it. Returns true if it went out.
+     */
+    bool sendDeferred();
+
+    /**
+     * False until tick() has run entering() in the current state.
+     */
+    bool hasEntered() {
+        return entered;
+    }
+
     PacketRadio *getRadio() {
         return radio;
     }
 
-};
+    Clock *getClock() {
+        return clock;
+    }
+
+    uint32_t now() {
+        return clock->millis();
+    }
+
+private:
+    bool reserveAirtime(LoraPacket &lora);
 
-extern Timer transmitting;
-extern Timer waitingOnAck;
+    /**
+     * Keeps a frame the duty cycle wouldn't let out. False if it's the one
+     * already held, being tried again, so the deferral is only logged once.
+     */
+    bool hold(LoraPacket &lora, fk_radio_PacketKind kind);
+
+};
 
 #endif
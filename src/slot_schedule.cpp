@@ -0,0 +1,122 @@
+#include "slot_schedule.h"
+
+static bool after(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) > 0;
+}
+
+UploadSlot *SlotSchedule::book(const NodeLoraId &nodeId, uint32_t now, uint32_t earliest, uint32_t estimated) {
+    expire(now);
+
+    auto existing = find(nodeId);
+    if (existing != nullptr) {
+        return existing;
+    }
+
+    UploadSlot *free = nullptr;
+    auto startsAt = earliest;
+    for (auto &slot : slots_) {
+        if (!slot.booked) {
+            if (free == nullptr) {
+                free = &slot;
+            }
+            continue;
+        }
+        if (after(slot.endsAt() + Guard, startsAt)) {
+            startsAt = slot.endsAt() + Guard;
+        }
+    }
+
+    if (free == nullptr) {
+        return nullptr;
+    }
+
+    auto past = history(nodeId);
+    auto ratio = (past != nullptr && past->ratio > 100) ? past->ratio : 100;
+
+    free->nodeId = nodeId;
+    free->startsAt = startsAt;
+    free->duration = (uint32_t)(((uint64_t)estimated * ratio) / 100);
+    free->estimated = estimated;
+    free->booked = true;
+
+    return free;
+}
+
+void SlotSchedule::release(const NodeLoraId &nodeId, uint32_t now) {
+    auto slot = find(nodeId);
+    if (slot == nullptr) {
+        return;
+    }
+
+    slot->booked = false;
+
+    if (slot->estimated == 0 || !after(now, slot->startsAt)) {
+        return;
+    }
+
+    auto ratio = (uint32_t)(((uint64_t)(now - slot->startsAt) * 100) / slot->estimated);
+    if (ratio > 400) {
+        ratio = 400;
+    }
+
+    auto past = history(nodeId);
+    if (past == nullptr) {
+        past = &history_[nextHistory_];
+        nextHistory_ = (nextHistory_ + 1) % MaximumHistory;
+        past->nodeId = nodeId;
+        past->ratio = ratio;
+    }
+    else {
+        past->ratio = (3 * past->ratio + ratio) / 4;
+    }
+}
+
+void SlotSchedule::active(const NodeLoraId &nodeId, uint32_t now) {
+    auto slot = find(nodeId);
+    if (slot != nullptr && after(now, slot->endsAt())) {
+        slot->duration = now - slot->startsAt;
+    }
+}
+
+void SlotSchedule::cancel(const NodeLoraId &nodeId) {
+    auto slot = find(nodeId);
+    if (slot != nullptr) {
+        slot->booked = false;
+    }
+}
+
+UploadSlot *SlotSchedule::find(const NodeLoraId &nodeId) {
+    for (auto &slot : slots_) {
+        if (slot.booked && slot.nodeId == nodeId) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+size_t SlotSchedule::booked() {
+    size_t n = 0;
+    for (auto &slot : slots_) {
+        if (slot.booked) {
+            n++;
+        }
+    }
+    return n;
+}
+
+void SlotSchedule::expire(uint32_t now) {
+    for (auto &slot : slots_) {
+        if (slot.booked && after(now, slot.endsAt() + Guard)) {
+            slot.booked = false;
+        }
+    }
+}
+
+SlotSchedule::History *SlotSchedule::history(const NodeLoraId &nodeId) {
+    for (auto &h : history_) {
+        if (h.ratio > 0 && h.nodeId == nodeId) {
+            return &h;
+        }
+    }
+    return nullptr;
+}
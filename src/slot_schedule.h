@@ -0,0 +1,80 @@
+#ifndef SLC_SLOT_SCHEDULE_H_INCLUDED
+#define SLC_SLOT_SCHEDULE_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+
+#include "device_id.h"
+
+struct UploadSlot {
+    NodeLoraId nodeId;
+    uint32_t startsAt{ 0 };
+    uint32_t duration{ 0 };
+    // What we estimated before applying the node's history.
+    uint32_t estimated{ 0 };
+    bool booked{ false };
+
+    uint32_t endsAt() const {
+        return startsAt + duration;
+    }
+};
+
+/**
+ * The gateway's upload timetable. Each node that asks is booked into the
+ * first free slot after everybody else, sized from what it's about to send
+ * and how long its uploads have taken compared to that in the past. Fixed
+ * size, so it's as happy on an MCU as on the Pi.
+ */
+class SlotSchedule {
+public:
+    static constexpr size_t MaximumSlots = 16;
+    static constexpr size_t MaximumHistory = 32;
+    // Quiet time between slots, to absorb clock error and late replies.
+    static constexpr uint32_t Guard = 250;
+
+private:
+    struct History {
+        NodeLoraId nodeId;
+        // Actual over estimated duration, in percent.
+        uint16_t ratio{ 0 };
+    };
+
+    UploadSlot slots_[MaximumSlots];
+    History history_[MaximumHistory];
+    size_t nextHistory_{ 0 };
+
+public:
+    /**
+     * Returns the node's slot, booking one of the estimated length starting
+     * no sooner than earliest if it doesn't have one. Returns nullptr when
+     * the schedule is full.
+     */
+    UploadSlot *book(const NodeLoraId &nodeId, uint32_t now, uint32_t earliest, uint32_t estimated);
+
+    /**
+     * Frees the node's slot and learns from how long it actually took.
+     */
+    void release(const NodeLoraId &nodeId, uint32_t now);
+
+    /**
+     * Notes the node is still uploading, stretching its slot if it's run
+     * over so nobody is booked on top of it.
+     */
+    void active(const NodeLoraId &nodeId, uint32_t now);
+
+    /**
+     * Frees the node's slot without learning anything from it.
+     */
+    void cancel(const NodeLoraId &nodeId);
+
+    UploadSlot *find(const NodeLoraId &nodeId);
+
+    size_t booked();
+
+private:
+    void expire(uint32_t now);
+    History *history(const NodeLoraId &nodeId);
+
+};
+
+#endif
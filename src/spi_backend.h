@@ -0,0 +1,66 @@
+#ifndef SLC_SPI_BACKEND_H_INCLUDED
+#define SLC_SPI_BACKEND_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+
+#if !defined(ARDUINO) && !defined(SLC_HOST)
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#endif
+
+/**
+ * The SPI bus and GPIO pins a radio driver talks through. LoraRadioPi goes
+ * through one of these rather than calling wiringPi directly, so it can be
+ * run against a software model of the chip.
+ */
+class SpiBackend {
+public:
+    virtual void pinMode(uint8_t pin, bool output) = 0;
+    virtual void digitalWrite(uint8_t pin, bool high) = 0;
+
+    /**
+     * Calls handler on a rising edge of pin, from whatever thread the
+     * backend delivers interrupts on.
+     */
+    virtual void attachInterrupt(uint8_t pin, void (*handler)()) = 0;
+
+    /**
+     * One full duplex transaction, buffer is overwritten with what was
+     * clocked back in.
+     */
+    virtual void transfer(uint8_t channel, uint8_t *buffer, size_t size) = 0;
+
+    virtual void delay(uint32_t ms) = 0;
+
+};
+
+#if !defined(ARDUINO) && !defined(SLC_HOST)
+
+class WiringPiSpiBackend : public SpiBackend {
+public:
+    void pinMode(uint8_t pin, bool output) override {
+        ::pinMode(pin, output ? OUTPUT : INPUT);
+    }
+
+    void digitalWrite(uint8_t pin, bool high) override {
+        ::digitalWrite(pin, high ? HIGH : LOW);
+    }
+
+    void attachInterrupt(uint8_t pin, void (*handler)()) override {
+        wiringPiISR(pin, INT_EDGE_RISING, handler);
+    }
+
+    void transfer(uint8_t channel, uint8_t *buffer, size_t size) override {
+        wiringPiSPIDataRW(channel, buffer, size);
+    }
+
+    void delay(uint32_t ms) override {
+        ::delay(ms);
+    }
+
+};
+
+#endif
+
+#endif
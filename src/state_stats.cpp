@@ -0,0 +1,79 @@
+#include "state_stats.h"
+
+size_t StateTime::bucket(uint32_t ms) {
+    size_t b = 0;
+    while (ms > 0 && b < Buckets - 1) {
+        ms >>= 1;
+        b++;
+    }
+    return b;
+}
+
+void StateTime::record(uint32_t ms) {
+    if (count == 0 || ms < minimum) {
+        minimum = ms;
+    }
+    if (ms > maximum) {
+        maximum = ms;
+    }
+    count++;
+    total += ms;
+    auto &n = histogram[bucket(ms)];
+    if (n < UINT16_MAX) {
+        n++;
+    }
+}
+
+void StateTime::merge(const StateTime &other) {
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0 || other.minimum < minimum) {
+        minimum = other.minimum;
+    }
+    if (other.maximum > maximum) {
+        maximum = other.maximum;
+    }
+    count += other.count;
+    total += other.total;
+    for (auto i = 0u; i < Buckets; ++i) {
+        auto sum = (uint32_t)histogram[i] + other.histogram[i];
+        histogram[i] = sum < UINT16_MAX ? sum : UINT16_MAX;
+    }
+}
+
+void StateStats::merge(const StateStats &other) {
+    for (auto i = 0u; i < NumberOfNetworkStates; ++i) {
+        states_[i].merge(other.states_[i]);
+    }
+}
+
+void StateStats::clear() {
+    for (auto &state : states_) {
+        state = StateTime{ };
+    }
+}
+
+uint64_t StateStats::total() const {
+    uint64_t total = 0;
+    for (auto &state : states_) {
+        total += state.total;
+    }
+    return total;
+}
+
+void StateStats::dump() {
+    for (auto i = 0u; i < NumberOfNetworkStates; ++i) {
+        auto &s = states_[i];
+        if (s.count == 0) {
+            continue;
+        }
+        auto log = slc::logErrors();
+        log << "State: " << (NetworkState)i << " " << s.count << "x " << s.total << "ms ("
+            << s.minimum << "/" << s.average() << "/" << s.maximum << "ms) [";
+        for (auto b = 0u; b < StateTime::Buckets; ++b) {
+            log << (b > 0 ? " " : "") << s.histogram[b];
+        }
+        log << "]";
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef SLC_STATE_STATS_H_INCLUDED
+#define SLC_STATE_STATS_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+
+#include "network_state.h"
+
+/**
+ * Time spent in one state. Histogram bucket 0 is under 1ms, bucket i covers
+ * [2^(i-1), 2^i) ms and the last bucket takes everything longer.
+ */
+struct StateTime {
+    static constexpr size_t Buckets = 16;
+
+    uint32_t count{ 0 };
+    uint32_t total{ 0 };
+    uint32_t minimum{ 0 };
+    uint32_t maximum{ 0 };
+    uint16_t histogram[Buckets] = { 0 };
+
+    void record(uint32_t ms);
+    void merge(const StateTime &other);
+
+    uint32_t average() const {
+        return count > 0 ? total / count : 0;
+    }
+
+    static size_t bucket(uint32_t ms);
+
+};
+
+/**
+ * How long a protocol spends in each state and how often it gets there,
+ * kept as it transitions. Cheap enough to always be on.
+ */
+class StateStats {
+private:
+    StateTime states_[NumberOfNetworkStates];
+
+public:
+    void record(NetworkState state, uint32_t ms) {
+        states_[(size_t)state].record(ms);
+    }
+
+    void merge(const StateStats &other);
+
+    void clear();
+
+    /**
+     * Logs a line for every state we've spent time in.
+     */
+    void dump();
+
+    const StateTime &operator[](NetworkState state) const {
+        return states_[(size_t)state];
+    }
+
+    uint64_t total() const;
+
+};
+
+#endif
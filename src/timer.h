@@ -1,18 +1,22 @@
 #ifndef SLC_TIMER_H_INCLUDED
 #define SLC_TIMER_H_INCLUDED
 
-#ifdef ARDUINO
-#include <Arduino.h>
-#else
-#include <wiringPi.h>
-#endif
+#include "clock.h"
 
 class Timer {
 private:
+    Clock *clock{ &slc::systemClock };
     uint32_t started{ 0 };
     uint32_t total{ 0 };
     uint32_t samples{ 0 };
 
+public:
+    Timer() {
+    }
+
+    Timer(Clock &clock) : clock(&clock) {
+    }
+
 public:
     void clear() {
         started = 0;
@@ -25,12 +29,12 @@ public:
     }
 
     void begin() {
-        started = millis();
+        started = clock->millis();
     }
 
     void end() {
         if (started > 0) {
-            total += millis() - started;
+            total += clock->millis() - started;
             started = 0;
             samples++;
         }
@@ -0,0 +1,54 @@
+#include "trace.h"
+#include "packets.h"
+#include "network_state.h"
+
+const char *getTraceEventName(TraceEvent event) {
+    switch (event) {
+    case TraceEvent::Sent: return "Sent";
+    case TraceEvent::Deferred: return "Deferred";
+    case TraceEvent::Received: return "Received";
+    case TraceEvent::Ack: return "Ack";
+    case TraceEvent::Data: return "Data";
+    case TraceEvent::Transition: return "Transition";
+    default: {
+        return "Unknown";
+    }
+    }
+}
+
+void TraceRing::dump() {
+    auto size = this->size();
+    slc::logErrors() << "Trace: " << (uint32_t)size << " of " << recorded_ << " events";
+    for (auto i = recorded_ - size; i != recorded_; ++i) {
+        auto &r = records_[i % Size];
+        auto log = slc::logErrors();
+        log << "Trace: " << r.time << " " << getTraceEventName(r.event);
+        switch (r.event) {
+        case TraceEvent::Sent:
+        case TraceEvent::Deferred:
+        case TraceEvent::Received: {
+            log << " " << (fk_radio_PacketKind)r.a << " " << r.b;
+            break;
+        }
+        case TraceEvent::Ack: {
+            log << " to " << r.a;
+            break;
+        }
+        case TraceEvent::Data: {
+            log << " @ " << r.b
+                << ((r.a & TraceDataDupe) ? " DUPE" : "") << ((r.a & TraceDataOverlap) ? " OVERLAP" : "")
+                << ((r.a & TraceDataGap) ? " GAP" : "") << ((r.a & TraceDataClosed) ? " CLOSED" : "")
+                << ((r.a & TraceDataFailed) ? " FAILED" : "");
+            break;
+        }
+        case TraceEvent::Transition: {
+            log << " " << (NetworkState)(r.a >> 8) << " -> " << (NetworkState)(r.a & 0xff) << " after " << r.b << "ms";
+            break;
+        }
+        default: {
+            break;
+        }
+        }
+    }
+    recorded_ = 0;
+}
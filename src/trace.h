@@ -0,0 +1,85 @@
+#ifndef SLC_TRACE_H_INCLUDED
+#define SLC_TRACE_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+
+#include "logging.h"
+
+#ifndef SLC_TRACE_SIZE
+#if defined(ARDUINO)
+#define SLC_TRACE_SIZE 64
+#else
+#define SLC_TRACE_SIZE 256
+#endif
+#endif
+
+enum class TraceEvent : uint16_t {
+    // a: kind, b: encoded size.
+    Sent,
+    // a: kind, b: duty cycle ms used.
+    Deferred,
+    // a: kind, b: encoded size.
+    Received,
+    // a: to address.
+    Ack,
+    // a: TraceData flags, b: offset.
+    Data,
+    // a: state left << 8 | state entered, b: ms spent in the state left.
+    Transition,
+};
+
+/**
+ * Flags for TraceEvent::Data.
+ */
+enum TraceData : uint16_t {
+    TraceDataDupe = 1,
+    TraceDataOverlap = 2,
+    TraceDataGap = 4,
+    TraceDataClosed = 8,
+    TraceDataFailed = 16,
+};
+
+struct TraceRecord {
+    uint32_t time;
+    TraceEvent event;
+    uint16_t a;
+    uint32_t b;
+};
+
+/**
+ * The last SLC_TRACE_SIZE protocol events, as fixed size binary records.
+ * Recording one is a couple of stores, so it's fine in the ACK path, and
+ * nothing is formatted until the ring is dumped.
+ */
+class TraceRing {
+public:
+    static constexpr size_t Size = SLC_TRACE_SIZE;
+
+private:
+    TraceRecord records_[Size];
+    uint32_t recorded_{ 0 };
+
+public:
+    void record(uint32_t time, TraceEvent event, uint16_t a = 0, uint32_t b = 0) {
+        auto &r = records_[recorded_++ % Size];
+        r.time = time;
+        r.event = event;
+        r.a = a;
+        r.b = b;
+    }
+
+    /**
+     * Logs everything in the ring, oldest first, and empties it.
+     */
+    void dump();
+
+    size_t size() {
+        return recorded_ < Size ? recorded_ : Size;
+    }
+
+};
+
+const char *getTraceEventName(TraceEvent event);
+
+#endif